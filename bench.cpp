@@ -0,0 +1,621 @@
+// Measures the overhead of the bindings themselves. Compile it like luamod.cpp, but as an executable, e.g.:
+// clang++ -std=c++20 -O2 bench.cpp soup_lua_deflate.cpp -I<path to Soup> -I<path to Lua or Pluto> <Soup library> <Lua or Pluto library> -o bench
+// Prints one JSON object per benchmark to stdout, so results of two builds can be diffed. An optional argument filters
+// benchmarks by name.
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+
+#include "soup_lua_bindings.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::atomic_size_t cpp_allocs{0};
+
+void* operator new(size_t size)
+{
+	++cpp_allocs;
+	if (auto p = std::malloc(size ? size : 1))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+static size_t lua_allocs = 0;
+
+static void* countingAlloc(void*, void* ptr, size_t, size_t nsize)
+{
+	if (nsize == 0)
+	{
+		std::free(ptr);
+		return nullptr;
+	}
+	if (!ptr)
+	{
+		++lua_allocs;
+	}
+	return std::realloc(ptr, nsize);
+}
+
+// The netIntel instance is never initialised, so lookups measure the path through the bindings rather than the search.
+struct BenchDataProvider : public soup::LuaBindings::DataProvider
+{
+	soup::netIntel intel{};
+
+	soup::netIntel& getNetIntel(lua_State*) override
+	{
+		return intel;
+	}
+};
+
+static uint32_t crc32(const std::string& data)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	for (const auto c : data)
+	{
+		crc ^= (uint8_t)c;
+		for (int k = 0; k != 8; ++k)
+		{
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+		}
+	}
+	return ~crc;
+}
+
+// Builds a ZIP file with the given number of stored entries.
+static std::string makeZip(size_t num_entries)
+{
+	const auto put16 = [](std::string& s, uint16_t v)
+	{
+		s.push_back((char)(v & 0xFF));
+		s.push_back((char)(v >> 8));
+	};
+	const auto put32 = [put16](std::string& s, uint32_t v)
+	{
+		put16(s, (uint16_t)(v & 0xFFFF));
+		put16(s, (uint16_t)(v >> 16));
+	};
+
+	std::string zip{};
+	std::string cd{};
+	for (size_t i = 0; i != num_entries; ++i)
+	{
+		const std::string name = "dir/file" + std::to_string(i) + ".txt";
+		const std::string data = "Hello from entry " + std::to_string(i);
+		const auto offset = (uint32_t)zip.size();
+		const auto crc = crc32(data);
+
+		put32(zip, 0x04034b50);
+		put16(zip, 10); // version needed
+		put16(zip, 0); // flags
+		put16(zip, 0); // compression method
+		put32(zip, 0); // mod time & date
+		put32(zip, crc);
+		put32(zip, (uint32_t)data.size());
+		put32(zip, (uint32_t)data.size());
+		put16(zip, (uint16_t)name.size());
+		put16(zip, 0); // extra length
+		zip.append(name);
+		zip.append(data);
+
+		put32(cd, 0x02014b50);
+		put16(cd, 10); // version made by
+		put16(cd, 10); // version needed
+		put16(cd, 0); // flags
+		put16(cd, 0); // compression method
+		put32(cd, 0); // mod time & date
+		put32(cd, crc);
+		put32(cd, (uint32_t)data.size());
+		put32(cd, (uint32_t)data.size());
+		put16(cd, (uint16_t)name.size());
+		put16(cd, 0); // extra length
+		put16(cd, 0); // comment length
+		put16(cd, 0); // disk number
+		put16(cd, 0); // internal attributes
+		put32(cd, 0); // external attributes
+		put32(cd, offset);
+		cd.append(name);
+	}
+	const auto cd_offset = (uint32_t)zip.size();
+	zip.append(cd);
+	put32(zip, 0x06054b50);
+	put16(zip, 0); // disk number
+	put16(zip, 0); // disk with central directory
+	put16(zip, (uint16_t)num_entries);
+	put16(zip, (uint16_t)num_entries);
+	put32(zip, (uint32_t)cd.size());
+	put32(zip, cd_offset);
+	put16(zip, 0); // comment length
+	return zip;
+}
+
+struct Benchmark
+{
+	const char* name;
+	size_t iterations;
+	const char* setup; // runs once, locals defined here are visible to the body
+	const char* body; // runs once per iteration, with `i` as the iteration number
+};
+
+static constexpr Benchmark benchmarks[] = {
+	// Constructors
+	{"Vector3.new", 1'000'000, "", "local v = soup.Vector3(1, 2, 3)"},
+	{"IpAddr.new(string)", 1'000'000, "", "local ip = soup.IpAddr(\"1.1.1.1\")"},
+	{"IpAddr.new(int)", 1'000'000, "", "local ip = soup.IpAddr(16843009)"},
+	{"Matrix.new", 1'000'000, "", "local m = soup.Matrix()"},
+
+	// Dispatch
+	{"Vector3.__index(getter)", 5'000'000, "local v = soup.Vector3(1, 2, 3)", "local x = v.x"},
+	{"Vector3.__newindex", 5'000'000, "local v = soup.Vector3(1, 2, 3)", "v.x = i"},
+	{"Vector3:length", 5'000'000, "local v = soup.Vector3(1, 2, 3)", "local l = v:length()"},
+	{"Vector3:add", 5'000'000, "local v, d = soup.Vector3(1, 2, 3), soup.Vector3(0, 0, 1)", "v:add(d)"},
+	{"Vector3.__add", 1'000'000, "local a, b = soup.Vector3(1, 2, 3), soup.Vector3(0, 0, 1)", "local c = a + b"},
+	{"checkTypename", 5'000'000, "local v = soup.Vector3(1, 2, 3)", "bench_checkTypename(v)"},
+	{"isType", 5'000'000, "local v = soup.Vector3(1, 2, 3)", "bench_isType(v)"},
+
+	// Math
+	{"Matrix.__mul", 1'000'000, "local m, v = soup.Matrix(), soup.Vector3(1, 2, 3) m:setPosRotXYZ(1, 2, 3, 0, 0, 90)", "local r = m * v"},
+	{"Matrix:transformInto", 5'000'000, "local m, v, out = soup.Matrix(), soup.Vector3(1, 2, 3), soup.Vector3() m:setPosRotXYZ(1, 2, 3, 0, 0, 90)", "m:transformInto(v, out)"},
+	{"Matrix:transformArray(1024)", 10'000, "local m, arr = soup.Matrix(), soup.Vector3Array(1024) m:setPosRotXYZ(1, 2, 3, 0, 0, 90)", "m:transformArray(arr, arr)"},
+
+	// I/O
+	{"ZipReader:getFileList(1000)", 1'000, "local zr = soup.ZipReader(soup.StringReader(bench_zip, false))", "local l = zr:getFileList()"},
+	{"ZipReader:find", 1'000'000, "local zr = soup.ZipReader(soup.StringReader(bench_zip, false))", "local f = zr:find(\"dir/file500.txt\")"},
+	{"ZipReader:getFileContents", 100'000, "local zr = soup.ZipReader(soup.StringReader(bench_zip, false)) local f = zr:find(\"dir/file500.txt\")", "local c = zr:getFileContents(f)"},
+	{"ZipReader(StringReader copy)", 1'000, "", "local zr = soup.ZipReader(soup.StringReader(bench_zip))"},
+	{"ZipWriter(64 x 80K, 1 thread)", 3, "local bufs = {} for j = 1, 64 do local t = {} for k = 1, 20000 do t[k] = (k * j) % 997 end bufs[j] = soup.Buffer(table.concat(t, \" \")) end", "local zw = soup.ZipWriter(nil, { threads = 1 }) for j = 1, #bufs do zw:add(\"f\" .. j, bufs[j]) end zw:finish()"},
+	{"ZipWriter(64 x 80K, all threads)", 3, "local bufs = {} for j = 1, 64 do local t = {} for k = 1, 20000 do t[k] = (k * j) % 997 end bufs[j] = soup.Buffer(table.concat(t, \" \")) end", "local zw = soup.ZipWriter() for j = 1, #bufs do zw:add(\"f\" .. j, bufs[j]) end zw:finish()"},
+
+	// Net
+	{"netIntel.getAsByIp", 1'000'000, "", "local as = soup.netIntel.getAsByIp(\"1.1.1.1\")"},
+	{"netIntel.getLocationByIp", 1'000'000, "", "local loc = soup.netIntel.getLocationByIp(16843009)"},
+	{"netIntel.enrich(1000)", 1'000, "local ips = {} for j = 1, 1000 do ips[j] = j * 16777259 % 4294967296 end", "local res = soup.netIntel.enrich(ips)"},
+
+	// End-to-end
+	{"script: transform points one by one", 100, R"(
+		local m = soup.Matrix()
+		m:setPosRotXYZ(1, 2, 3, 0, 0, 90)
+		local pts = {}
+		for j = 1, 1000 do pts[j] = soup.Vector3(j, j, j) end
+	)", "for j = 1, #pts do pts[j] = m * pts[j] end"},
+	{"script: enrich access log", 100, R"(
+		local ips = {}
+		for j = 1, 1000 do ips[j] = (j % 100) .. ".1.2.3" end
+	)", R"(
+		local counts = {}
+		for _, ip in ipairs(ips) do
+			local as = soup.netIntel.getAsByIp(ip)
+			local key = as and as.handle or "unknown"
+			counts[key] = (counts[key] or 0) + 1
+		end
+	)"},
+};
+
+static int lua_bench_checkTypename(lua_State* L)
+{
+	soup::LuaBindings::checkTypename(L, 1, "soup::Vector3");
+	return 0;
+}
+
+static int lua_bench_isType(lua_State* L)
+{
+	lua_pushboolean(L, soup::LuaBindings::isType(L, 1, soup::LuaBindings::desc_Vector3()));
+	return 1;
+}
+
+// Counts GC cycles with an object that is collected once per cycle and then replaced by a new one.
+static constexpr const char* gc_counter_script = R"(
+	local cycles = 0
+	local function sentinel()
+		setmetatable({}, { __gc = function()
+			cycles = cycles + 1
+			sentinel()
+		end })
+	end
+	sentinel()
+	return function() return cycles end
+)";
+
+static bool runBenchmark(lua_State* L, const Benchmark& b)
+{
+	const std::string script = std::string(b.setup) + "\nreturn function(n) for i = 1, n do " + b.body + " end end";
+	if (luaL_loadstring(L, script.c_str()) != LUA_OK
+		|| lua_pcall(L, 0, 1, 0) != LUA_OK
+		)
+	{
+		std::fprintf(stderr, "%s: %s\n", b.name, lua_tostring(L, -1));
+		lua_pop(L, 1);
+		return false;
+	}
+
+	// Warm up, so the metatables exist and caches are hot.
+	lua_pushvalue(L, -1);
+	lua_pushinteger(L, (lua_Integer)(b.iterations / 10 + 1));
+	if (lua_pcall(L, 1, 0, 0) != LUA_OK)
+	{
+		std::fprintf(stderr, "%s: %s\n", b.name, lua_tostring(L, -1));
+		lua_pop(L, 2);
+		return false;
+	}
+	lua_gc(L, LUA_GCCOLLECT, 0);
+
+	lua_getglobal(L, "bench_gc_cycles");
+	lua_call(L, 0, 1);
+	const auto gc_cycles_before = lua_tointeger(L, -1);
+	lua_pop(L, 1);
+
+	const auto lua_allocs_before = lua_allocs;
+	const auto cpp_allocs_before = cpp_allocs.load();
+	const auto start = std::chrono::steady_clock::now();
+	lua_pushinteger(L, (lua_Integer)b.iterations);
+	if (lua_pcall(L, 1, 0, 0) != LUA_OK)
+	{
+		std::fprintf(stderr, "%s: %s\n", b.name, lua_tostring(L, -1));
+		lua_pop(L, 1);
+		return false;
+	}
+	const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	const auto lua_allocs_delta = lua_allocs - lua_allocs_before;
+	const auto cpp_allocs_delta = cpp_allocs.load() - cpp_allocs_before;
+
+	lua_getglobal(L, "bench_gc_cycles");
+	lua_call(L, 0, 1);
+	const auto gc_cycles = lua_tointeger(L, -1) - gc_cycles_before;
+	lua_pop(L, 1);
+
+	std::printf(R"({"name":"%s","iterations":%zu,"ns_per_op":%.2f,"lua_allocs_per_op":%.3f,"cpp_allocs_per_op":%.3f,"gc_cycles":%lld})" "\n",
+		b.name,
+		b.iterations,
+		(double)ns / b.iterations,
+		(double)lua_allocs_delta / b.iterations,
+		(double)cpp_allocs_delta / b.iterations,
+		(long long)gc_cycles
+	);
+	std::fflush(stdout);
+	return true;
+}
+
+struct StartupBenchmark
+{
+	const char* name;
+	const char* script; // runs after soup has been opened, or nullptr
+};
+
+// Measures creating a state, opening soup in it, using some of it, and closing the state again.
+static constexpr StartupBenchmark startup_benchmarks[] = {
+	{"startup: open", nullptr},
+	{"startup: open + Vector3", "local v = soup.Vector3(1, 2, 3)"},
+	{"startup: open + all submodules", "for k in pairs(soup) do end"},
+};
+
+static bool runStartupBenchmark(const StartupBenchmark& b)
+{
+	static constexpr size_t iterations = 10'000;
+
+	const auto lua_allocs_before = lua_allocs;
+	const auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i != iterations; ++i)
+	{
+		lua_State* L = lua_newstate(&countingAlloc, nullptr);
+		luaL_openlibs(L);
+		soup::LuaBindings::open(L);
+		if (b.script && luaL_dostring(L, b.script) != LUA_OK)
+		{
+			std::fprintf(stderr, "%s: %s\n", b.name, lua_tostring(L, -1));
+			lua_close(L);
+			return false;
+		}
+		lua_close(L);
+	}
+	const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+	std::printf(R"({"name":"%s","iterations":%zu,"ns_per_op":%.2f,"lua_allocs_per_op":%.3f})" "\n",
+		b.name,
+		iterations,
+		(double)ns / iterations,
+		(double)(lua_allocs - lua_allocs_before) / iterations
+	);
+	std::fflush(stdout);
+	return true;
+}
+
+struct StressCase
+{
+	std::string ip;
+	lua_Integer as_a; // AS number when dataset A is published, 0 for none
+	lua_Integer as_b;
+};
+
+// Looks up each IP in a state of its own that only ever sees the given data, to find out what it answers.
+static std::vector<lua_Integer> lookUpAsNumbers(const std::shared_ptr<soup::netIntel>& intel, const std::vector<std::string>& ips)
+{
+	lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+	soup::LuaBindings::open(L);
+	auto source = std::make_shared<soup::LuaBindings::NetIntelSource>();
+	source->publish(intel);
+	soup::LuaBindings::setNetIntelSource(L, std::move(source));
+
+	std::vector<lua_Integer> numbers{};
+	luaL_loadstring(L, "local as = soup.netIntel.getAsByIp(...) return as and as.number or 0");
+	for (const auto& ip : ips)
+	{
+		lua_pushvalue(L, -1);
+		lua_pushstring(L, ip.c_str());
+		lua_call(L, 1, 1);
+		numbers.emplace_back(lua_tointeger(L, -1));
+		lua_pop(L, 1);
+	}
+	lua_close(L);
+	return numbers;
+}
+
+// Picks IPv4 and IPv6 addresses spread over the address space that exactly one of the datasets knows an AS for.
+static std::vector<StressCase> makeStressCases(const std::shared_ptr<soup::netIntel>& a, const std::shared_ptr<soup::netIntel>& b)
+{
+	std::vector<std::string> ips{};
+	char buf[40];
+	for (uint32_t i = 0; i != 1000; ++i)
+	{
+		const uint32_t x = i * 2654435761u;
+		if (i % 2 == 0)
+		{
+			std::snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (x >> 24) % 223 + 1, (x >> 16) & 0xFF, (x >> 8) & 0xFF, x & 0xFF);
+		}
+		else
+		{
+			std::snprintf(buf, sizeof(buf), "2%03x:%x::1", (x >> 20) & 0x3FF, x & 0xFFFF);
+		}
+		ips.emplace_back(buf);
+	}
+	const auto as_a = lookUpAsNumbers(a, ips);
+	const auto as_b = lookUpAsNumbers(b, ips);
+
+	std::vector<StressCase> cases{};
+	for (size_t i = 0; i != ips.size(); ++i)
+	{
+		if (as_a[i] != as_b[i])
+		{
+			cases.emplace_back(StressCase{ std::move(ips[i]), as_a[i], as_b[i] });
+		}
+	}
+	return cases;
+}
+
+static void pushStressCases(lua_State* L, const std::vector<StressCase>& cases)
+{
+	lua_createtable(L, (int)cases.size(), 0);
+	for (size_t i = 0; i != cases.size(); ++i)
+	{
+		lua_createtable(L, 3, 0);
+		lua_pushstring(L, cases[i].ip.c_str());
+		lua_rawseti(L, -2, 1);
+		lua_pushinteger(L, cases[i].as_a);
+		lua_rawseti(L, -2, 2);
+		lua_pushinteger(L, cases[i].as_b);
+		lua_rawseti(L, -2, 3);
+		lua_rawseti(L, -2, (lua_Integer)i + 1);
+	}
+}
+
+// Runs one state per thread, all reading netIntel data from the shared source while it's being swapped between two datasets
+// underneath them: A only has the IPv4 data and B only the IPv6 data, so the addresses looked up are ones that exactly one of
+// them knows an AS for. Every lookup must give the answer of A or of B, and both must be seen. The states are only closed at
+// the end, so that their contexts can't share an address by reuse.
+// Soup can only fill a netIntel by downloading its data, so this is skipped when that fails.
+static bool runMultiStateStress()
+{
+	static constexpr const char* name = "netIntel multi-state stress";
+	static constexpr size_t iterations = 1'000'000;
+	const auto num_threads = std::max(2u, std::thread::hardware_concurrency());
+
+	auto a = std::make_shared<soup::netIntel>();
+	auto b = std::make_shared<soup::netIntel>();
+	try
+	{
+		a->init(true, false);
+		b->init(false, true);
+	}
+	catch (const std::exception& e)
+	{
+		std::fprintf(stderr, "%s: skipped, failed to load the netIntel data: %s\n", name, e.what());
+		return true;
+	}
+	if (!a->isInited() || !b->isInited())
+	{
+		std::fprintf(stderr, "%s: skipped, failed to load the netIntel data\n", name);
+		return true;
+	}
+	const auto cases = makeStressCases(a, b);
+	if (cases.empty())
+	{
+		std::fprintf(stderr, "%s: the datasets don't know an AS for any of the addresses\n", name);
+		return false;
+	}
+	soup::LuaBindings::getDefaultNetIntelSource()->publish(a);
+
+	struct State
+	{
+		lua_State* L = nullptr;
+		const soup::LuaBindings::BindingsContext* ctx = nullptr;
+		lua_Integer seen_a = 0;
+		lua_Integer seen_b = 0;
+	};
+	std::vector<State> states(num_threads);
+
+	std::atomic_size_t running{num_threads};
+	std::atomic_size_t failed{0};
+	std::vector<std::thread> threads{};
+	const auto start = std::chrono::steady_clock::now();
+	for (unsigned int t = 0; t != num_threads; ++t)
+	{
+		threads.emplace_back([&, t]
+		{
+			auto& s = states[t];
+			lua_State* L = s.L = luaL_newstate();
+			luaL_openlibs(L);
+			soup::LuaBindings::open(L);
+			s.ctx = &soup::LuaBindings::getContext(L);
+			const std::string script = R"(
+				local cases = ...
+				local seen_a, seen_b = 0, 0
+				soup.netIntel.setCacheSize(256)
+				for i = 1, )" + std::to_string(iterations) + R"( do
+					local case = cases[i % #cases + 1]
+					local as = soup.netIntel.getAsByIp(case[1])
+					local number = as and as.number or 0
+					if number == case[2] then
+						seen_a = seen_a + 1
+					elseif number == case[3] then
+						seen_b = seen_b + 1
+					else
+						error(case[1] .. " gave AS " .. number .. ", which neither dataset has for it")
+					end
+				end
+				return seen_a, seen_b
+			)";
+			bool ok = (luaL_loadstring(L, script.c_str()) == LUA_OK);
+			if (ok)
+			{
+				pushStressCases(L, cases);
+				ok = (lua_pcall(L, 1, 2, 0) == LUA_OK);
+			}
+			if (!ok)
+			{
+				std::fprintf(stderr, "%s: %s\n", name, lua_tostring(L, -1));
+				++failed;
+			}
+			else
+			{
+				s.seen_a = lua_tointeger(L, -2);
+				s.seen_b = lua_tointeger(L, -1);
+			}
+			--running;
+		});
+	}
+	size_t swaps = 0;
+	while (running != 0)
+	{
+		soup::LuaBindings::getDefaultNetIntelSource()->publish(++swaps % 2 ? b : a);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+	const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+	lua_Integer seen_a = 0;
+	lua_Integer seen_b = 0;
+	for (size_t i = 0; i != states.size(); ++i)
+	{
+		seen_a += states[i].seen_a;
+		seen_b += states[i].seen_b;
+		for (size_t j = 0; j != i; ++j)
+		{
+			if (states[i].ctx == states[j].ctx)
+			{
+				std::fprintf(stderr, "%s: states %zu and %zu share a context\n", name, j, i);
+				++failed;
+			}
+		}
+	}
+	if (failed == 0 && (seen_a == 0 || seen_b == 0))
+	{
+		std::fprintf(stderr, "%s: only one of the datasets was ever seen\n", name);
+		++failed;
+	}
+	for (auto& s : states)
+	{
+		lua_close(s.L);
+	}
+
+	std::printf(R"({"name":"%s","threads":%u,"iterations":%zu,"ns_per_op":%.2f,"swaps":%zu,"addresses":%zu,"seen_a":%lld,"seen_b":%lld})" "\n",
+		name,
+		num_threads,
+		iterations * num_threads,
+		(double)ns / (iterations * num_threads),
+		swaps,
+		cases.size(),
+		(long long)seen_a,
+		(long long)seen_b
+	);
+	std::fflush(stdout);
+	return failed == 0;
+}
+
+int main(int argc, const char** argv)
+{
+	soup::LuaBindings::data_provider = soup::make_unique<BenchDataProvider>();
+
+	lua_State* L = lua_newstate(&countingAlloc, nullptr);
+	luaL_openlibs(L);
+	soup::LuaBindings::open(L);
+
+	lua_register(L, "bench_checkTypename", &lua_bench_checkTypename);
+	lua_register(L, "bench_isType", &lua_bench_isType);
+
+	const auto zip = makeZip(1000);
+	lua_pushlstring(L, zip.data(), zip.size());
+	lua_setglobal(L, "bench_zip");
+
+	luaL_dostring(L, gc_counter_script);
+	lua_setglobal(L, "bench_gc_cycles");
+
+	int failed = 0;
+	for (const auto& b : benchmarks)
+	{
+		if (argc > 1 && !std::strstr(b.name, argv[1]))
+		{
+			continue;
+		}
+		if (!runBenchmark(L, b))
+		{
+			++failed;
+		}
+	}
+
+	lua_close(L);
+
+	for (const auto& b : startup_benchmarks)
+	{
+		if (argc > 1 && !std::strstr(b.name, argv[1]))
+		{
+			continue;
+		}
+		if (!runStartupBenchmark(b))
+		{
+			++failed;
+		}
+	}
+
+	if (argc <= 1 || std::strstr("netIntel multi-state stress", argv[1]))
+	{
+		if (!runMultiStateStress())
+		{
+			++failed;
+		}
+	}
+	return failed != 0;
+}
@@ -1,4 +1,4 @@
-// Soup Lua Bindings are entirely contained within the .hpp
+// Soup Lua Bindings are contained within the .hpp, except for the deflate encoder in soup_lua_deflate.cpp
 // This file only serves for those who want to compile them to a Lua module.
 
 #include <lua.h>
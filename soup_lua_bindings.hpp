@@ -1,6 +1,26 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 // assuming <lua.h> & <lauxlib.h> are already included!
 
@@ -8,23 +28,54 @@
 #include <soup/audMixer.hpp>
 #include <soup/audPlayback.hpp>
 #include <soup/audWav.hpp>
+#include <soup/base.hpp>
 #include <soup/country_names.hpp>
+#include <soup/crc32.hpp>
+#include <soup/Exception.hpp>
 #include <soup/FileReader.hpp>
-#include <soup/joaat.hpp>
+#include <soup/filesystem.hpp>
 #include <soup/IpAddr.hpp>
 #include <soup/Matrix.hpp>
+#include <soup/MemoryRefReader.hpp>
 #include <soup/netIntel.hpp>
 #include <soup/StringReader.hpp>
 #include <soup/Vector3.hpp>
 #include <soup/ZipReader.hpp>
 
+#include "soup_lua_deflate.hpp"
+
+#if SOUP_X86
+#include <immintrin.h>
+#endif
+
+#if !SOUP_WINDOWS
+#include <sys/mman.h>
+#endif
+
+// Opt-in instrumentation of all bindings, see soup.stats in LUA_API.md. Disabled builds don't contain any of it.
+#ifndef SOUP_LUA_BINDINGS_STATS
+#define SOUP_LUA_BINDINGS_STATS false
+#endif
+
 namespace soup
 {
 	// If you're not using Pluto, your compiler might raise warnings because the error functions don't have the [[noreturn]] attribute in stock lua.
 
 	struct LuaBindings
 	{
-#define pushNewAndBeginMt(T, ...) pushNewAndBeginMtImpl<T>(L, "soup::" #T, __VA_ARGS__);
+		// Describes a bound type once; all of its instances share one metatable that is built from this on first use.
+		// Methods are looked up through a plain table, getters and setters through a name-keyed table of C functions,
+		// so `obj.field` and `obj:method()` cost a single probe against the key's precomputed string hash.
+		// The descriptor's address doubles as the type's tag, see isType.
+		struct TypeDesc
+		{
+			const char* name;
+			const TypeDesc&(*base)() = nullptr;
+			const luaL_Reg* methods = nullptr;
+			const luaL_Reg* getters = nullptr;
+			const luaL_Reg* setters = nullptr;
+			const luaL_Reg* metamethods = nullptr;
+		};
 
 #pragma region C++ API
 
@@ -34,517 +85,5481 @@ namespace soup
 		static constexpr auto PLUTO_PATCH = (PLUTO_VERSION[10] - '0');
 #endif
 
-		struct DataProvider
+		// A bounded LRU cache of netIntel lookup results, as real traffic tends to hit the same few IPs over and over again.
+		// It's disabled while the capacity is 0. The cached pointers point into the netIntel data, so invalidate must be called
+		// when that is reloaded.
+		struct NetIntelCache
 		{
-			virtual netIntel& getNetIntel(lua_State* L)
+			struct Stats
 			{
-				Exception::purecall();
-			}
-		};
-
-		static inline UniquePtr<DataProvider> data_provider{};
+				uint64_t hits;
+				uint64_t misses;
+				uint64_t evictions;
+				size_t size;
+				size_t capacity;
+			};
 
-		static void open(lua_State* L)
-		{
-			if (!data_provider)
+			void setCapacity(size_t capacity)
 			{
-				data_provider = soup::make_unique<DataProvider>();
+				std::lock_guard lock(mtx);
+				this->capacity = capacity;
+				evictExcess();
 			}
 
-			open_pushTable(L);
-
-			lua_setglobal(L, "soup");
-		}
-
-		static void open_pushTable(lua_State* L)
-		{
-			lua_newtable(L);
+			void invalidate()
+			{
+				std::lock_guard lock(mtx);
+				index.clear();
+				lru.clear();
+				++generation;
+			}
 
-			open_setAudioFields(L);
-			open_setIoFields(L);
-			open_setMathFields(L);
-			open_setNetFields(L);
-		}
-#pragma endregion C++ API
+			[[nodiscard]] Stats getStats()
+			{
+				std::lock_guard lock(mtx);
+				return Stats{ hits, misses, evictions, lru.size(), capacity };
+			}
 
-#pragma region Lua API - Audio
-		static void open_setAudioFields(lua_State* L)
-		{
-			// audDevice
+			[[nodiscard]] const netAs* getAsByIp(const netIntel& intel, const IpAddr& ip)
 			{
-				const luaL_Reg functions[] = {
-					{"getDefault", &lua_audDevice_getDefault},
-					{nullptr, nullptr}
-				};
-				luaL_newlib(L, functions);
-				lua_setfield(L, -2, "audDevice");
+				return lookup(ip, &Result::as, [&intel, &ip]
+				{
+					return intel.getAsByIp(ip);
+				});
 			}
 
-			lua_pushcfunction(L, &lua_audMixer);
-			lua_setfield(L, -2, "audMixer");
+			[[nodiscard]] const netIntelLocationData* getLocationByIp(const netIntel& intel, const IpAddr& ip)
+			{
+				return lookup(ip, &Result::location, [&intel, &ip]
+				{
+					return intel.getLocationByIp(ip);
+				});
+			}
 
-			lua_pushcfunction(L, &lua_audWav);
-			lua_setfield(L, -2, "audWav");
-		}
+		private:
+			struct Result
+			{
+				std::optional<const netAs*> as{};
+				std::optional<const netIntelLocationData*> location{};
+			};
 
-		static int lua_audDevice_getDefault(lua_State* L)
-		{
-			return tryCatch(L, [](lua_State* L)
+			struct IpAddrHash
 			{
-				pushNewAndBeginMt(audDevice, audDevice::getDefault());
+				[[nodiscard]] size_t operator()(const IpAddr& ip) const noexcept
 				{
-					lua_pushstring(L, "__index");
-					lua_pushcfunction(L, [](lua_State* L) -> int
-					{
-						switch (joaat::hash(luaL_checkstring(L, 2)))
-						{
-						case joaat::hash("getName"):
-							lua_pushcfunction(L, [](lua_State* L) -> int
-							{
-								pushString(L, reinterpret_cast<audDevice*>(lua_touserdata(L, 1))->getName());
-								return 1;
-							});
-							return 1;
-
-						case joaat::hash("open"):
-							lua_pushcfunction(L, [](lua_State* L) -> int
-							{
-								auto pb = pushNewAudPlayback(L);
-								pb->open(*reinterpret_cast<audDevice*>(lua_touserdata(L, 1)), (int)luaL_optinteger(L, 2, 1));
-								return 1;
-							});
-							return 1;
-						}
-						return 0;
-					});
-					lua_settable(L, -3);
+					return std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char*>(&ip), sizeof(ip)));
 				}
-				lua_setmetatable(L, -2);
-				return 1;
-			});
-		}
+			};
 
-		static int lua_audMixer(lua_State* L)
-		{
-			pushNewAndBeginMt(audMixer);
+			std::mutex mtx{};
+			size_t capacity = 0;
+			std::list<std::pair<IpAddr, Result>> lru{}; // most recently used first
+			std::unordered_map<IpAddr, decltype(lru)::iterator, IpAddrHash> index{};
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint64_t evictions = 0;
+			uint64_t generation = 0; // so results of searches that raced with invalidate are not cached
+
+			template <typename T, typename F>
+			[[nodiscard]] const T* lookup(const IpAddr& ip, std::optional<const T*> Result::*field, F&& search)
 			{
-				lua_pushstring(L, "__index");
-				lua_pushcfunction(L, [](lua_State* L) -> int
+				uint64_t gen;
 				{
-					switch (joaat::hash(luaL_checkstring(L, 2)))
+					std::lock_guard lock(mtx);
+					if (capacity == 0)
 					{
-					case joaat::hash("stop_playback_when_done"):
-						lua_pushboolean(L, reinterpret_cast<audMixer*>(lua_touserdata(L, 1))->stop_playback_when_done);
-						return 1;
+						return search();
+					}
+					if (auto e = index.find(ip); e != index.end() && (e->second->second.*field).has_value())
+					{
+						++hits;
+						lru.splice(lru.begin(), lru, e->second);
+						return *(e->second->second.*field);
+					}
+					++misses;
+					gen = generation;
+				}
 
-					case joaat::hash("setOutput"):
-						lua_pushcfunction(L, [](lua_State* L) -> int
-						{
-							checkTypename(L, 2, "soup::audPlayback");
-							reinterpret_cast<audMixer*>(lua_touserdata(L, 1))->setOutput(*reinterpret_cast<audPlayback*>(lua_touserdata(L, 2)));
-							return 0;
-						});
-						return 1;
+				// The search itself happens without holding the lock, so concurrent lookups don't have to wait for each other.
+				const T* res = search();
 
-					case joaat::hash("playSound"):
-						lua_pushcfunction(L, [](lua_State* L) -> int
-						{
-							checkTypeExtendsAudSound(L, 2);
-							return tryCatch(L, [](lua_State* L)
-							{
-								reinterpret_cast<audMixer*>(lua_touserdata(L, 1))->playSound(*reinterpret_cast<SharedPtr<audSound>*>(lua_touserdata(L, 2)));
-								return 0;
-							});
-						});
-						return 1;
-					}
-					return 0;
-				});
-				lua_settable(L, -3);
-			}
-			{
-				lua_pushstring(L, "__newindex");
-				lua_pushcfunction(L, [](lua_State* L) -> int
+				std::lock_guard lock(mtx);
+				if (capacity != 0 && gen == generation)
 				{
-					switch (joaat::hash(luaL_checkstring(L, 2)))
+					auto e = index.find(ip);
+					if (e == index.end())
 					{
-					case joaat::hash("stop_playback_when_done"):
-						reinterpret_cast<audMixer*>(lua_touserdata(L, 1))->stop_playback_when_done = lua_toboolean(L, 2);
-						return 1;
+						lru.emplace_front(ip, Result{});
+						e = index.emplace(ip, lru.begin()).first;
+						evictExcess();
 					}
-					return 0;
-				});
-				lua_settable(L, -3);
+					else
+					{
+						lru.splice(lru.begin(), lru, e->second);
+					}
+					e->second->second.*field = res;
+				}
+				return res;
 			}
-			lua_setmetatable(L, -2);
-			return 1;
-		}
 
-		static int lua_audWav(lua_State* L)
-		{
-			checkTypeExtendsReader(L, 1);
-			return tryCatch(L, [](lua_State* L)
+			void evictExcess()
 			{
-				pushNewAndBeginMt(SharedPtr<soup::audWav>, soup::make_shared<audWav>(*reinterpret_cast<soup::Reader*>(lua_touserdata(L, 1))));
+				while (lru.size() > capacity)
 				{
-					lua_pushstring(L, "__index");
-					lua_pushcfunction(L, [](lua_State* L) -> int
-					{
-						switch (joaat::hash(luaL_checkstring(L, 2)))
-						{
-						case joaat::hash("channels"):
-							lua_pushinteger(L, (*reinterpret_cast<SharedPtr<audWav>*>(lua_touserdata(L, 1)))->channels);
-							return 1;
-						}
-						return 0;
-					});
-					lua_settable(L, -3);
+					index.erase(lru.back().first);
+					lru.pop_back();
+					++evictions;
 				}
-				lua_setmetatable(L, -2);
-				return 1;
-			});
-		}
-#pragma endregion Lua API - Audio
+			}
+		};
 
-#pragma region Lua API - Net
-		static void open_setNetFields(lua_State* L)
+		struct DataProvider
 		{
-			// netIntel
+			virtual ~DataProvider() = default;
+
+			virtual netIntel& getNetIntel(lua_State* L)
 			{
-				const luaL_Reg functions[] = {
-					{"getAsByIp", &lua_netIntel_getAsByIp},
-					{"getLocationByIp", &lua_netIntel_getLocationByIp},
-					{nullptr, nullptr}
-				};
-				luaL_newlib(L, functions);
-				lua_setfield(L, -2, "netIntel");
+				Exception::purecall();
 			}
 
-			lua_pushcfunction(L, &lua_getCountryName);
-			lua_setfield(L, -2, "getCountryName");
+			// Called on a background thread by soup.netIntel.preload, so it must not touch any lua_State.
+			virtual netIntel& loadNetIntel()
+			{
+				return getNetIntel(nullptr);
+			}
+		};
 
-			lua_pushcfunction(L, &lua_IpAddr);
-			lua_setfield(L, -2, "IpAddr");
-		}
+		// Default for all states. Only set it before states are used on other threads.
+		static inline UniquePtr<DataProvider> data_provider{};
 
-		static int lua_netIntel_getAsByIp(lua_State* L)
+		// An immutable netIntel instance that any number of states on any number of threads may read from.
+		struct NetIntelSnapshot
 		{
-			return tryCatch(L, [](lua_State* L)
+			std::shared_ptr<netIntel> intel;
+			uint64_t generation;
+		};
+
+		// Hands out the current NetIntelSnapshot to the states using it and can load it on a background thread. Publishing a new
+		// snapshot doesn't wait for readers: each state moves on at its next lookup, and the old snapshot is freed once the last
+		// one has. Readers only take the mutex when the generation has changed.
+		// `error` is written before `state` changes from LOADING, so it can be read without locking once it has.
+		struct NetIntelSource
+		{
+			enum State : uint8_t
 			{
-				auto as = data_provider->getNetIntel(L).getAsByIp(checkIpAddr(L, 1));
-				if (!as)
+				IDLE,
+				LOADING,
+				READY,
+				FAILED,
+			};
+
+			std::atomic<State> state{IDLE};
+			std::atomic_bool background{false}; // whether LOADING is start's thread rather than a state in acquireOrLoad
+			std::atomic<uint64_t> generation{0}; // 0 while nothing has been published
+			std::string error{};
+
+			std::mutex mtx{};
+			std::condition_variable cv{};
+			std::thread thrd{};
+			std::shared_ptr<const NetIntelSnapshot> snapshot{};
+
+			~NetIntelSource()
+			{
+				if (thrd.joinable())
 				{
-					return 0;
+					thrd.join();
 				}
-				pushNewAndBeginMt(netAs, *as);
+			}
+
+			// Atomically replaces the data that states read from, e.g. to hot-reload it.
+			void publish(std::shared_ptr<netIntel> intel)
+			{
 				{
-					lua_pushstring(L, "__index");
-					lua_pushcfunction(L, [](lua_State* L) -> int
-					{
-						switch (joaat::hash(luaL_checkstring(L, 2)))
-						{
-						case joaat::hash("isValid"):
-							lua_pushcfunction(L, &lua_mm_isValid);
-							return 1;
+					std::lock_guard lock(mtx);
+					publishLocked(std::move(intel));
+				}
+				cv.notify_all();
+			}
 
-						case joaat::hash("number"):
-							lua_pushinteger(L, reinterpret_cast<netAs*>(checkMediumUserdata(L, 1))->number);
-							return 1;
+			[[nodiscard]] std::shared_ptr<const NetIntelSnapshot> acquire()
+			{
+				std::lock_guard lock(mtx);
+				return snapshot;
+			}
 
-						case joaat::hash("handle"):
-							lua_pushstring(L, reinterpret_cast<netAs*>(checkMediumUserdata(L, 1))->handle);
-							return 1;
+			// Loads the data on the calling thread unless something has been published already. Concurrent callers, including
+			// ones that come in while start's thread is loading, wait for that load rather than all loading it. The provider may
+			// raise a Lua error, so it's called in protected mode and without the mutex held; its error is rethrown afterwards.
+			[[nodiscard]] std::shared_ptr<const NetIntelSnapshot> acquireOrLoad(DataProvider& provider, lua_State* L)
+			{
+				std::unique_lock lock(mtx);
+				cv.wait(lock, [this]
+				{
+					return state != LOADING;
+				});
+				if (snapshot)
+				{
+					return snapshot;
+				}
+				if (state == FAILED)
+				{
+					throw Exception(error);
+				}
+				state = LOADING;
+				lock.unlock();
 
-						case joaat::hash("name"):
-							lua_pushstring(L, reinterpret_cast<netAs*>(checkMediumUserdata(L, 1))->name);
-							return 1;
+				lua_pushcfunction(L, &lua_getNetIntel);
+				lua_pushlightuserdata(L, &provider);
+				const auto status = lua_pcall(L, 1, 1, 0);
 
-						case joaat::hash("isHosting"):
-							lua_pushcfunction(L, [](lua_State* L) -> int
-							{
-								lua_pushboolean(L, reinterpret_cast<netAs*>(checkMediumUserdata(L, 1))->isHosting(data_provider->getNetIntel(L)));
-								return 1;
-							});
-							return 1;
-						}
-						return 0;
-					});
-					lua_settable(L, -3);
+				lock.lock();
+				if (status == LUA_OK)
+				{
+					publishLocked(borrow(*reinterpret_cast<netIntel*>(lua_touserdata(L, -1))));
+					state = READY;
 				}
-				lua_setmetatable(L, -2);
-				return 1;
-			});
-		}
+				else
+				{
+					state = IDLE; // not FAILED, so the next lookup tries again, like it did before anyone waited on it
+				}
+				auto res = snapshot;
+				lock.unlock();
+				cv.notify_all();
 
-		static int lua_netIntel_getLocationByIp(lua_State* L)
-		{
-			return tryCatch(L, [](lua_State* L)
+				if (status != LUA_OK)
+				{
+					std::string msg = lua_type(L, -1) == LUA_TSTRING ? lua_tostring(L, -1) : "Failed to load netIntel data";
+					lua_pop(L, 1);
+					throw Exception(std::move(msg));
+				}
+				lua_pop(L, 1);
+				return res;
+			}
+
+			// Also retries after a background load failed. Lookups keep raising its error until then.
+			void start(DataProvider& provider)
 			{
-				auto location = data_provider->getNetIntel(L).getLocationByIp(checkIpAddr(L, 1));
-				if (!location)
+				std::lock_guard lock(mtx);
+				if ((state != IDLE && state != FAILED) || snapshot)
 				{
-					return 0;
+					return;
 				}
-				pushNewAndBeginMt(netIntelLocationData, *location);
+				if (thrd.joinable())
 				{
-					lua_pushstring(L, "__index");
-					lua_pushcfunction(L, [](lua_State* L) -> int
+					thrd.join(); // the failed load's thread, which is done with the mutex by the time state is FAILED
+				}
+				error.clear();
+				state = LOADING;
+				background = true;
+				thrd = std::thread([this, &provider]
+				{
+					try
 					{
-						switch (joaat::hash(luaL_checkstring(L, 2)))
-						{
-						case joaat::hash("isValid"):
-							lua_pushcfunction(L, &lua_mm_isValid);
-							return 1;
-
-						case joaat::hash("city"):
-							lua_pushstring(L, reinterpret_cast<netIntelLocationData*>(checkMediumUserdata(L, 1))->city);
-							return 1;
+						auto intel = borrow(provider.loadNetIntel());
+						std::lock_guard lock(mtx);
+						publishLocked(std::move(intel));
+						state = READY;
+					}
+					catch (std::exception& e)
+					{
+						std::lock_guard lock(mtx);
+						error = e.what();
+						state = FAILED;
+					}
+					cv.notify_all();
+				});
+			}
 
-						case joaat::hash("state"):
-							lua_pushstring(L, reinterpret_cast<netIntelLocationData*>(checkMediumUserdata(L, 1))->state);
-							return 1;
+			// The error of the last failed background load. Locked, since a retry may be replacing it.
+			[[nodiscard]] std::string getError()
+			{
+				std::lock_guard lock(mtx);
+				return error;
+			}
 
-						case joaat::hash("country_code"):
-							lua_pushstring(L, reinterpret_cast<netIntelLocationData*>(checkMediumUserdata(L, 1))->country_code.c_str());
-							return 1;
-						}
-						return 0;
-					});
-					lua_settable(L, -3);
+			// Returns false if the loading is still not done after the timeout.
+			[[nodiscard]] bool waitFor(std::optional<std::chrono::milliseconds> timeout)
+			{
+				std::unique_lock lock(mtx);
+				const auto done = [this]
+				{
+					return state != LOADING;
+				};
+				if (!timeout)
+				{
+					cv.wait(lock, done);
+					return true;
 				}
-				lua_setmetatable(L, -2);
-				return 1;
-			});
-		}
+				return cv.wait_for(lock, *timeout, done);
+			}
 
-		static int lua_getCountryName(lua_State* L)
-		{
-			if (lua_gettop(L) >= 2)
+		private:
+			static int lua_getNetIntel(lua_State* L)
 			{
-				pushString(L, getCountryName(luaL_checkstring(L, 1), luaL_checkstring(L, 2)));
+				return tryCatch(L, [](lua_State* L)
+				{
+					lua_pushlightuserdata(L, &reinterpret_cast<DataProvider*>(lua_touserdata(L, 1))->getNetIntel(L));
+					return 1;
+				});
 			}
-			else
+
+			// The DataProvider keeps ownership of what it hands out.
+			[[nodiscard]] static std::shared_ptr<netIntel> borrow(netIntel& intel)
 			{
-				pushString(L, getCountryName(luaL_checkstring(L, 1)));
+				return std::shared_ptr<netIntel>(&intel, [](netIntel*) {});
 			}
-			return 1;
+
+			void publishLocked(std::shared_ptr<netIntel> intel)
+			{
+				const auto gen = generation.load(std::memory_order_relaxed) + 1;
+				snapshot = std::make_shared<const NetIntelSnapshot>(NetIntelSnapshot{ std::move(intel), gen });
+				generation.store(gen, std::memory_order_release);
+			}
+		};
+
+		// open sets up a default provider, but hosts that only use luaopen_soup may never have set one.
+		[[nodiscard]] static DataProvider& checkDataProvider(lua_State* L)
+		{
+			if (!data_provider)
+			{
+				luaL_error(L, "No DataProvider has been set, so netIntel data can't be loaded");
+			}
+			return *data_provider;
 		}
 
-		static int lua_IpAddr(lua_State* L)
+		// Constructed on first use, so it's destroyed before data_provider, which the loading thread uses.
+		[[nodiscard]] static const std::shared_ptr<NetIntelSource>& getDefaultNetIntelSource()
 		{
-			pushNewAndBeginMt(IpAddr, checkIpAddr(L, 1));
+			static const auto inst = std::make_shared<NetIntelSource>();
+			return inst;
+		}
+
+		struct IoJob;
+
+		// Where finished IoJobs are handed back to the state that started them. Shared with the jobs, as they may outlive it.
+		struct IoCompletionQueue
+		{
+			std::mutex mtx{};
+			std::condition_variable cv{};
+			std::deque<SharedPtr<IoJob>> completed{};
+			std::function<void()> notify{}; // called on a worker thread with the queue locked, e.g. to wake up the host's event loop
+
+			void push(SharedPtr<IoJob>&& job)
 			{
-				lua_pushstring(L, "__index");
-				lua_pushcfunction(L, [](lua_State* L) -> int
 				{
-					switch (joaat::hash(luaL_checkstring(L, 2)))
+					std::lock_guard lock(mtx);
+					completed.emplace_back(std::move(job));
+					if (notify)
 					{
-					case joaat::hash("getReverseDns"):
-						lua_pushcfunction(L, [](lua_State* L) -> int
-						{
-							pushString(L, reinterpret_cast<IpAddr*>(lua_touserdata(L, 1))->getReverseDns());
-							return 1;
-						});
-						return 1;
+						notify();
 					}
-					return 0;
-				});
-				lua_settable(L, -3);
+				}
+				cv.notify_all();
+			}
+
+			[[nodiscard]] SharedPtr<IoJob> pop()
+			{
+				std::lock_guard lock(mtx);
+				if (completed.empty())
+				{
+					return {};
+				}
+				auto job = std::move(completed.front());
+				completed.pop_front();
+				return job;
 			}
+
+			// Returns false if no job is done after the timeout.
+			[[nodiscard]] bool waitFor(std::optional<std::chrono::milliseconds> timeout)
+			{
+				std::unique_lock lock(mtx);
+				const auto any_done = [this]
+				{
+					return !completed.empty();
+				};
+				if (!timeout)
+				{
+					cv.wait(lock, any_done);
+					return true;
+				}
+				return cv.wait_for(lock, *timeout, any_done);
+			}
+
+			void setNotify(std::function<void()> f)
+			{
+				std::lock_guard lock(mtx);
+				notify = std::move(f);
+			}
+		};
+
+		// State that the bindings keep per lua_State (shared by its coroutines), so that states on different threads don't share
+		// anything mutable. Created on first use and stored in the registry.
+		struct BindingsContext
+		{
+			std::shared_ptr<NetIntelSource> net_intel_source = getDefaultNetIntelSource();
+			std::shared_ptr<const NetIntelSnapshot> net_intel{};
+			NetIntelCache net_intel_cache{};
+			std::shared_ptr<IoCompletionQueue> io_completions = std::make_shared<IoCompletionQueue>();
+
+			// Returns nullptr while the data is still being loaded in the background.
+			[[nodiscard]] netIntel* getNetIntelIfReady(lua_State* L)
+			{
+				auto& src = *net_intel_source;
+				if (src.generation.load(std::memory_order_acquire) != (net_intel ? net_intel->generation : 0))
+				{
+					useSnapshot(src.acquire());
+				}
+				if (net_intel)
+				{
+					return net_intel->intel.get();
+				}
+				switch (src.state.load())
+				{
+				case NetIntelSource::LOADING:
+					if (src.background)
+					{
+						return nullptr;
+					}
+					break; // another state is loading it synchronously, so wait for it in acquireOrLoad
+
+				case NetIntelSource::FAILED:
+					throw Exception(src.getError());
+
+				default:
+					break;
+				}
+				useSnapshot(src.acquireOrLoad(checkDataProvider(L), L));
+				return net_intel->intel.get();
+			}
+
+			[[nodiscard]] const netAs* getAsByIp(lua_State* L, const IpAddr& ip)
+			{
+				auto intel = getNetIntelIfReady(L);
+				return intel ? net_intel_cache.getAsByIp(*intel, ip) : nullptr;
+			}
+
+			[[nodiscard]] const netIntelLocationData* getLocationByIp(lua_State* L, const IpAddr& ip)
+			{
+				auto intel = getNetIntelIfReady(L);
+				return intel ? net_intel_cache.getLocationByIp(*intel, ip) : nullptr;
+			}
+
+		private:
+			void useSnapshot(std::shared_ptr<const NetIntelSnapshot>&& snapshot)
+			{
+				net_intel = std::move(snapshot);
+				net_intel_cache.invalidate(); // the cached pointers point into the previous snapshot
+			}
+		};
+
+		static inline const char context_key{};
+
+		[[nodiscard]] static BindingsContext& getContext(lua_State* L)
+		{
+			if (lua_rawgetp(L, LUA_REGISTRYINDEX, &context_key) != LUA_TUSERDATA)
+			{
+				lua_pop(L, 1);
+				pushNew<BindingsContext>(L);
+				lua_createtable(L, 0, 1);
+				addDtorToMt<BindingsContext>(L);
+				lua_setmetatable(L, -2);
+				lua_pushvalue(L, -1);
+				lua_rawsetp(L, LUA_REGISTRYINDEX, &context_key);
+			}
+			auto ctx = reinterpret_cast<BindingsContext*>(lua_touserdata(L, -1));
+			lua_pop(L, 1); // still referenced by the registry
+			return *ctx;
+		}
+
+		// Makes the given state read its netIntel data from another source than the one shared by default.
+		static void setNetIntelSource(lua_State* L, std::shared_ptr<NetIntelSource> source)
+		{
+			auto& ctx = getContext(L);
+			ctx.net_intel_source = std::move(source);
+			ctx.net_intel.reset();
+			ctx.net_intel_cache.invalidate();
+		}
+
+		static void open(lua_State* L)
+		{
+			if (!data_provider)
+			{
+				data_provider = soup::make_unique<DataProvider>();
+			}
+
+			open_pushTable(L);
+
+			lua_setglobal(L, "soup");
+		}
+
+		// Serves small blocks, like the userdata of Vector3, IpAddr and Matrix instances, from per-size-class free lists in
+		// slabs, and forwards everything else to the allocator it wraps. Not thread-safe, just like the lua_State it's used for.
+		struct PoolAllocator
+		{
+			static constexpr size_t GRANULARITY = 16;
+			static constexpr size_t MAX_POOLED = 256;
+			static constexpr size_t NUM_CLASSES = MAX_POOLED / GRANULARITY;
+			static constexpr size_t SLAB_SIZE = 16 * 1024;
+
+			// Slabs are carved from chunks that double in size, so telling a pooled block from one of the wrapped allocator's
+			// takes a few range checks. Once all chunks are used up, small blocks come from the wrapped allocator as well.
+			static constexpr size_t FIRST_CHUNK_SIZE = 4 * SLAB_SIZE;
+			static constexpr size_t MAX_CHUNKS = 16;
+
+			struct Stats
+			{
+				size_t slabs;
+				size_t blocks_in_use;
+				size_t bytes_in_use; // of the pooled blocks' size classes
+				size_t bytes_requested; // by the pooled allocations, so the difference to bytes_in_use is internal fragmentation
+				size_t bytes_free; // in free lists and not yet carved from slabs
+				uint64_t pooled_allocs;
+				uint64_t fallback_allocs;
+
+				// Portion of the slabs' memory that is not in use.
+				[[nodiscard]] double getFragmentation() const noexcept
+				{
+					return slabs ? (double)bytes_free / (double)(slabs * SLAB_SIZE) : 0.0;
+				}
+			};
+
+			lua_Alloc next = &mallocAlloc;
+			void* next_ud = nullptr;
+
+		private:
+			struct FreeBlock
+			{
+				FreeBlock* next;
+			};
+
+			struct SizeClass
+			{
+				FreeBlock* free_list = nullptr;
+				uint8_t* cursor = nullptr; // uncarved rest of the newest slab
+				uint8_t* end = nullptr;
+				size_t in_use = 0;
+				size_t free = 0;
+			};
+
+			struct Chunk
+			{
+				uint8_t* begin;
+				size_t size;
+			};
+
+			std::array<SizeClass, NUM_CLASSES> classes{};
+			std::array<Chunk, MAX_CHUNKS> chunks{};
+			size_t num_chunks = 0;
+			size_t num_slabs = 0; // carved from the chunks so far; the newest chunk's rest follows them
+			size_t bytes_requested = 0;
+			uint64_t pooled_allocs = 0;
+			uint64_t fallback_allocs = 0;
+
+		public:
+			PoolAllocator() noexcept = default;
+
+			// For installing the pool on an existing state, see open.
+			PoolAllocator(lua_Alloc next, void* next_ud) noexcept
+				: next(next), next_ud(next_ud)
+			{
+			}
+
+			PoolAllocator(const PoolAllocator&) = delete;
+			PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+			// The lua_State using this allocator must have been closed by now.
+			~PoolAllocator()
+			{
+				for (size_t i = 0; i != num_chunks; ++i)
+				{
+					::operator delete(chunks[i].begin);
+				}
+			}
+
+			static void* alloc(void* ud, void* ptr, size_t osize, size_t nsize) noexcept
+			{
+				auto& pool = *reinterpret_cast<PoolAllocator*>(ud);
+				if (!ptr)
+				{
+					// Lua also "frees" null pointers, e.g. the arrays of empty tables.
+					return (nsize != 0 ? pool.allocate(nsize) : nullptr);
+				}
+				if (!pool.isPooled(ptr, osize))
+				{
+					// Blocks of the wrapped allocator stay with it, also when they shrink to a pooled size.
+					return pool.next(pool.next_ud, ptr, osize, nsize);
+				}
+				if (nsize == 0)
+				{
+					pool.deallocate(ptr, osize);
+					return nullptr;
+				}
+				if (nsize <= MAX_POOLED && getClassIndex(nsize) == getClassIndex(osize))
+				{
+					pool.bytes_requested += nsize;
+					pool.bytes_requested -= osize;
+					return ptr;
+				}
+				if (void* res = pool.allocate(nsize))
+				{
+					memcpy(res, ptr, std::min(osize, nsize));
+					pool.deallocate(ptr, osize);
+					return res;
+				}
+				if (nsize < osize)
+				{
+					// Lua relies on shrinking never failing. The block is big enough for the smaller size class, so it just
+					// moves there, losing the rest of its bytes until the pool is destroyed.
+					pool.classes[getClassIndex(osize)].in_use--;
+					pool.classes[getClassIndex(nsize)].in_use++;
+					pool.bytes_requested += nsize;
+					pool.bytes_requested -= osize;
+					return ptr;
+				}
+				return nullptr;
+			}
+
+			[[nodiscard]] Stats getStats() const noexcept
+			{
+				Stats stats{ num_slabs, 0, 0, bytes_requested, 0, pooled_allocs, fallback_allocs };
+				for (size_t i = 0; i != NUM_CLASSES; ++i)
+				{
+					const auto block_size = (i + 1) * GRANULARITY;
+					stats.blocks_in_use += classes[i].in_use;
+					stats.bytes_in_use += classes[i].in_use * block_size;
+					stats.bytes_free += classes[i].free * block_size + (classes[i].end - classes[i].cursor);
+				}
+				return stats;
+			}
+
+		private:
+			static void* mallocAlloc(void*, void* ptr, size_t, size_t nsize) noexcept
+			{
+				if (nsize == 0)
+				{
+					free(ptr);
+					return nullptr;
+				}
+				return realloc(ptr, nsize);
+			}
+
+			[[nodiscard]] static constexpr size_t getClassIndex(size_t size) noexcept
+			{
+				return (size - 1) / GRANULARITY;
+			}
+
+			// Blocks may also come from the wrapped allocator if the pool was installed on an existing state, or if it ran out of
+			// chunks. Pooled blocks never exceed MAX_POOLED, so larger ones don't need the range checks.
+			[[nodiscard]] bool isPooled(void* ptr, size_t size) const noexcept
+			{
+				if (size > MAX_POOLED)
+				{
+					return false;
+				}
+				const auto addr = reinterpret_cast<uintptr_t>(ptr);
+				for (size_t i = num_chunks; i-- != 0; ) // the newest chunk is the largest
+				{
+					if (addr - reinterpret_cast<uintptr_t>(chunks[i].begin) < chunks[i].size)
+					{
+						return true;
+					}
+				}
+				return false;
+			}
+
+			[[nodiscard]] uint8_t* newSlab() noexcept
+			{
+				if (num_chunks == 0 || num_slabs * SLAB_SIZE == getChunksSize())
+				{
+					if (num_chunks == MAX_CHUNKS)
+					{
+						return nullptr;
+					}
+					const size_t size = (FIRST_CHUNK_SIZE << num_chunks);
+					auto chunk = reinterpret_cast<uint8_t*>(::operator new(size, std::nothrow));
+					if (!chunk)
+					{
+						return nullptr;
+					}
+					chunks[num_chunks++] = Chunk{ chunk, size };
+				}
+				const auto& chunk = chunks[num_chunks - 1];
+				const auto slab = chunk.begin + chunk.size - (getChunksSize() - num_slabs * SLAB_SIZE);
+				++num_slabs;
+				return slab;
+			}
+
+			[[nodiscard]] size_t getChunksSize() const noexcept
+			{
+				return FIRST_CHUNK_SIZE * ((size_t(1) << num_chunks) - 1);
+			}
+
+			[[nodiscard]] void* allocate(size_t size) noexcept
+			{
+				if (size > MAX_POOLED)
+				{
+					++fallback_allocs;
+					return next(next_ud, nullptr, 0, size);
+				}
+				auto& sc = classes[getClassIndex(size)];
+				const auto block_size = (getClassIndex(size) + 1) * GRANULARITY;
+				void* block;
+				if (sc.free_list)
+				{
+					block = sc.free_list;
+					sc.free_list = sc.free_list->next;
+					--sc.free;
+				}
+				else
+				{
+					if (sc.cursor == sc.end)
+					{
+						auto slab = newSlab();
+						if (!slab)
+						{
+							++fallback_allocs;
+							return next(next_ud, nullptr, 0, size);
+						}
+						sc.cursor = slab;
+						sc.end = slab + (SLAB_SIZE / block_size) * block_size;
+					}
+					block = sc.cursor;
+					sc.cursor += block_size;
+				}
+				++sc.in_use;
+				++pooled_allocs;
+				bytes_requested += size;
+				return block;
+			}
+
+			void deallocate(void* ptr, size_t size) noexcept
+			{
+				auto& sc = classes[getClassIndex(size)];
+				auto block = reinterpret_cast<FreeBlock*>(ptr);
+				block->next = sc.free_list;
+				sc.free_list = block;
+				--sc.in_use;
+				++sc.free;
+				bytes_requested -= size;
+			}
+		};
+
+		// Like open, but also makes the state allocate through the pool from now on. The pool must outlive the state.
+		static void open(lua_State* L, PoolAllocator& pool)
+		{
+			pool.next = lua_getallocf(L, &pool.next_ud);
+			lua_setallocf(L, &PoolAllocator::alloc, &pool);
+			open(L);
+		}
+
+		// The submodules are only opened when one of their fields is first accessed, so states that only use a few of them
+		// don't pay for the rest.
+		static void open_pushTable(lua_State* L)
+		{
+			lua_newtable(L);
+			open_setStatsField(L);
+
+			lua_createtable(L, 0, 2);
+			pushNew<uint32_t>(L, 0u); // bitmask of the submodules that have been opened
+			lua_pushvalue(L, -1);
+			lua_pushcclosure(L, &lua_soup_index, 1);
+			lua_setfield(L, -3, "__index");
+			lua_pushcclosure(L, &lua_soup_pairs, 1);
+			lua_setfield(L, -2, "__pairs");
+			lua_setmetatable(L, -2);
+		}
+
+		// A field of the soup table: a function, or a library of functions if lib is set.
+		struct FieldReg
+		{
+			const char* name;
+			lua_CFunction func;
+			const luaL_Reg* lib = nullptr;
+		};
+
+		// The registration table is both what opening the submodule sets and what tells lua_soup_index which one to open.
+		struct Submodule
+		{
+			const FieldReg* fields; // terminated by a null name
+
+			[[nodiscard]] bool hasField(const char* name) const noexcept
+			{
+				for (auto f = fields; f->name; ++f)
+				{
+					if (strcmp(f->name, name) == 0)
+					{
+						return true;
+					}
+				}
+				return false;
+			}
+
+			// Sets the fields on the table at the top of the stack.
+			void open(lua_State* L) const
+			{
+				for (auto f = fields; f->name; ++f)
+				{
+					if (f->lib)
+					{
+						lua_newtable(L);
+						luaL_setfuncs(L, f->lib, 0);
+					}
+					else
+					{
+						lua_pushcfunction(L, f->func);
+					}
+					lua_setfield(L, -2, f->name);
+				}
+			}
+		};
+
+		[[nodiscard]] static const std::array<Submodule, 4>& getSubmodules()
+		{
+			static const std::array<Submodule, 4> submodules{ {
+				{ getAudioFields() },
+				{ getIoFields() },
+				{ getMathFields() },
+				{ getNetFields() },
+			} };
+			return submodules;
+		}
+
+		// Sets the submodule's fields on the soup table at the top of the stack.
+		static void open_submodule(lua_State* L, const Submodule& submodule)
+		{
+#if SOUP_LUA_BINDINGS_STATS
+			// Instrument the new fields on their own, so nothing that's already there gets wrapped again.
+			lua_newtable(L);
+			submodule.open(L);
+			instrumentTable(L, "soup");
+			lua_pushnil(L);
+			while (lua_next(L, -2))
+			{
+				lua_pushvalue(L, -2);
+				lua_insert(L, -2);
+				lua_rawset(L, -5);
+			}
+			lua_pop(L, 1);
+#else
+			submodule.open(L);
+#endif
+		}
+
+		// upvalue 1 = bitmask of the submodules that have been opened
+		static int lua_soup_index(lua_State* L)
+		{
+			if (lua_type(L, 2) != LUA_TSTRING)
+			{
+				return 0;
+			}
+			auto& opened = *reinterpret_cast<uint32_t*>(lua_touserdata(L, lua_upvalueindex(1)));
+			const auto& submodules = getSubmodules();
+			for (size_t i = 0; i != submodules.size(); ++i)
+			{
+				if (!(opened & (1 << i)) && submodules[i].hasField(lua_tostring(L, 2)))
+				{
+					opened |= (1 << i);
+					lua_settop(L, 2);
+					lua_pushvalue(L, 1);
+					open_submodule(L, submodules[i]);
+					lua_pop(L, 1);
+					lua_rawget(L, 1);
+					return 1;
+				}
+			}
+			return 0;
+		}
+
+		// Iterating over the soup table opens all submodules, so nothing is missing.
+		// upvalue 1 = bitmask of the submodules that have been opened
+		static int lua_soup_pairs(lua_State* L)
+		{
+			auto& opened = *reinterpret_cast<uint32_t*>(lua_touserdata(L, lua_upvalueindex(1)));
+			const auto& submodules = getSubmodules();
+			lua_settop(L, 1);
+			for (size_t i = 0; i != submodules.size(); ++i)
+			{
+				if (!(opened & (1 << i)))
+				{
+					opened |= (1 << i);
+					open_submodule(L, submodules[i]);
+				}
+			}
+			lua_pushcfunction(L, [](lua_State* L) -> int
+			{
+				lua_settop(L, 2);
+				if (lua_next(L, 1))
+				{
+					return 2;
+				}
+				lua_pushnil(L);
+				return 1;
+			});
+			lua_insert(L, 1);
+			lua_pushnil(L);
+			return 3;
+		}
+#pragma endregion C++ API
+
+#pragma region Lua API - Audio
+		static const FieldReg* getAudioFields()
+		{
+			static constexpr luaL_Reg aud_device[] = {
+				{"getDefault", &lua_audDevice_getDefault},
+				{nullptr, nullptr}
+			};
+			static constexpr FieldReg fields[] = {
+				{"audDevice", nullptr, aud_device},
+				{"audMixer", &lua_audMixer},
+				{"audWav", &lua_audWav},
+				{nullptr, nullptr},
+			};
+			return fields;
+		}
+
+		static const TypeDesc& desc_audDevice()
+		{
+			static constexpr luaL_Reg methods[] = {
+				{"getName", [](lua_State* L) -> int
+				{
+					pushString(L, reinterpret_cast<audDevice*>(lua_touserdata(L, 1))->getName());
+					return 1;
+				}},
+				{"open", [](lua_State* L) -> int
+				{
+					auto pb = pushNewAudPlayback(L);
+					pb->open(*reinterpret_cast<audDevice*>(lua_touserdata(L, 1)), (int)luaL_optinteger(L, 2, 1));
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::audDevice",
+				.methods = methods,
+			};
+			return desc;
+		}
+
+		static int lua_audDevice_getDefault(lua_State* L)
+		{
+			return tryCatch(L, [](lua_State* L)
+			{
+				pushNewWithMt<audDevice>(L, desc_audDevice(), audDevice::getDefault());
+				return 1;
+			});
+		}
+
+		// Single-producer/single-consumer ring. Neither side ever waits on the other; a full ring makes tryPush fail instead.
+		// Not over-aligned because it lives in Lua userdata, so the indices are kept apart by padding instead.
+		template <typename T, size_t Capacity>
+		struct SpscRing
+		{
+			static_assert(std::has_single_bit(Capacity));
+
+			std::array<T, Capacity> slots{};
+			std::atomic<size_t> head{ 0 }; // written by the consumer
+			char pad[64]{};
+			std::atomic<size_t> tail{ 0 }; // written by the producer
+
+			[[nodiscard]] bool tryPush(T&& value)
+			{
+				const auto t = tail.load(std::memory_order_relaxed);
+				if (t - head.load(std::memory_order_acquire) == Capacity)
+				{
+					return false;
+				}
+				slots[t & (Capacity - 1)] = std::move(value);
+				tail.store(t + 1, std::memory_order_release);
+				return true;
+			}
+
+			[[nodiscard]] bool tryPop(T& out)
+			{
+				const auto h = head.load(std::memory_order_relaxed);
+				if (h == tail.load(std::memory_order_acquire))
+				{
+					return false;
+				}
+				out = std::move(slots[h & (Capacity - 1)]);
+				head.store(h + 1, std::memory_order_release);
+				return true;
+			}
+
+			[[nodiscard]] size_t size() const noexcept
+			{
+				return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+			}
+		};
+
+		struct MixerCommand
+		{
+			enum Op : uint8_t
+			{
+				PLAY_SOUND,
+				STOP,
+				START,
+				SET_VOLUME,
+				SET_PAN,
+				SET_STOP_PLAYBACK_WHEN_DONE,
+			};
+
+			Op op = PLAY_SOUND;
+			float value = 0.0f;
+			SharedPtr<audSound> sound{};
+			std::chrono::steady_clock::time_point enqueued{};
+		};
+
+		// Owns an audMixer and sits between it and the playback. Lua only ever enqueues commands; the render thread applies them
+		// at the start of each block, so the mixer's state is only touched from one thread.
+		struct MixerControl
+		{
+			audMixer mix{};
+			SpscRing<MixerCommand, 256> queue{};
+
+			// Producer side
+			bool stop_playback_when_done = false; // what Lua last asked for
+			bool attached = false; // a device playback is pulling from the mixer, so Lua must not consume the queue itself
+			uint64_t overflows = 0;
+
+			// Consumer side; atomic since a device playback may be running on the audio thread while Lua reads or renders
+			audFillBlock mix_src = nullptr;
+			void* mix_user_data = nullptr;
+			std::atomic<float> volume{ 1.0f };
+			std::atomic<float> pan{ 0.0f };
+			std::atomic_bool stopped{ false };
+			std::atomic_bool rendering_offline{ false }; // no playback to stop when the mixer runs dry
+			std::atomic_bool mix_stop_playback_when_done{ false };
+			std::atomic<uint64_t> applied{ 0 };
+			std::atomic<uint64_t> latency_total_ns{ 0 };
+			std::atomic<uint64_t> latency_max_ns{ 0 };
+
+			bool enqueue(MixerCommand::Op op, float value = 0.0f, SharedPtr<audSound> sound = {})
+			{
+				if (!queue.tryPush(MixerCommand{ op, value, std::move(sound), std::chrono::steady_clock::now() }))
+				{
+					++overflows;
+					return false;
+				}
+				return true;
+			}
+
+			void setOutput(audPlayback& pb)
+			{
+				// Let the mixer configure a scratch playback so we learn its callback without it ever being live.
+				audPlayback scratch;
+				mix.setOutput(scratch);
+				mix_src = scratch.src;
+				mix_user_data = scratch.user_data;
+
+				pb.user_data = this;
+				pb.src = &fillBlock;
+			}
+
+			static void fillBlock(audPlayback& pb, audSample* block)
+			{
+				auto& self = *reinterpret_cast<MixerControl*>(pb.user_data);
+				self.drainQueue();
+				if (self.stopped.load(std::memory_order_relaxed))
+				{
+					std::fill_n(block, AUD_BLOCK_SAMPLES, audSample{ 0 });
+					return;
+				}
+				self.mix.stop_playback_when_done = self.mix_stop_playback_when_done.load(std::memory_order_relaxed) && !self.rendering_offline.load(std::memory_order_relaxed);
+				pb.user_data = self.mix_user_data;
+				self.mix_src(pb, block);
+				pb.user_data = &self;
+				self.applyGain(block, pb.channels);
+			}
+
+			void drainQueue()
+			{
+				const auto now = std::chrono::steady_clock::now();
+				for (MixerCommand cmd; queue.tryPop(cmd); )
+				{
+					switch (cmd.op)
+					{
+					case MixerCommand::PLAY_SOUND:
+						mix.playSound(std::move(cmd.sound));
+						break;
+
+					case MixerCommand::STOP:
+						stopped.store(true, std::memory_order_relaxed);
+						break;
+
+					case MixerCommand::START:
+						stopped.store(false, std::memory_order_relaxed);
+						break;
+
+					case MixerCommand::SET_VOLUME:
+						volume.store(cmd.value, std::memory_order_relaxed);
+						break;
+
+					case MixerCommand::SET_PAN:
+						pan.store(cmd.value, std::memory_order_relaxed);
+						break;
+
+					case MixerCommand::SET_STOP_PLAYBACK_WHEN_DONE:
+						mix_stop_playback_when_done.store(cmd.value != 0.0f, std::memory_order_relaxed);
+						break;
+					}
+					const auto latency = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - cmd.enqueued).count();
+					latency_total_ns.fetch_add(latency, std::memory_order_relaxed);
+					if (latency > latency_max_ns.load(std::memory_order_relaxed))
+					{
+						latency_max_ns.store(latency, std::memory_order_relaxed);
+					}
+					applied.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+
+			void applyGain(audSample* block, int channels) const noexcept
+			{
+				const float volume = this->volume.load(std::memory_order_relaxed);
+				const float pan = this->pan.load(std::memory_order_relaxed);
+				if (volume == 1.0f && (pan == 0.0f || channels != 2))
+				{
+					return;
+				}
+				float gains[2] = { volume, volume };
+				if (channels == 2)
+				{
+					gains[0] *= std::min(1.0f, 1.0f - pan);
+					gains[1] *= std::min(1.0f, 1.0f + pan);
+				}
+				for (size_t i = 0; i != AUD_BLOCK_SAMPLES; ++i)
+				{
+					const float v = block[i] * gains[channels == 2 ? (i & 1) : 0];
+					block[i] = (audSample)std::clamp(v, -32768.0f, 32767.0f);
+				}
+			}
+		};
+
+		static const TypeDesc& desc_audMixer()
+		{
+			static constexpr luaL_Reg methods[] = {
+				{"setOutput", [](lua_State* L) -> int
+				{
+					checkType(L, 2, desc_audPlayback());
+					auto& ctrl = *reinterpret_cast<MixerControl*>(lua_touserdata(L, 1));
+					if (ctrl.attached)
+					{
+						// A second playback would be a second consumer of the command queue.
+						luaL_error(L, "mixer already has an output");
+					}
+					ctrl.setOutput(*reinterpret_cast<audPlayback*>(lua_touserdata(L, 2)));
+					ctrl.attached = true;
+					lua_pushvalue(L, 1);
+					lua_setiuservalue(L, 2, 1); // the playback calls into the mixer, so it must not be collected first
+					return 0;
+				}},
+				{"playSound", [](lua_State* L) -> int
+				{
+					checkType(L, 2, desc_audSound());
+					auto& ctrl = *reinterpret_cast<MixerControl*>(lua_touserdata(L, 1));
+					lua_pushboolean(L, ctrl.enqueue(MixerCommand::PLAY_SOUND, 0.0f, *reinterpret_cast<SharedPtr<audSound>*>(lua_touserdata(L, 2))));
+					return 1;
+				}},
+				{"stop", [](lua_State* L) -> int
+				{
+					lua_pushboolean(L, reinterpret_cast<MixerControl*>(lua_touserdata(L, 1))->enqueue(MixerCommand::STOP));
+					return 1;
+				}},
+				{"start", [](lua_State* L) -> int
+				{
+					lua_pushboolean(L, reinterpret_cast<MixerControl*>(lua_touserdata(L, 1))->enqueue(MixerCommand::START));
+					return 1;
+				}},
+				{"setVolume", [](lua_State* L) -> int
+				{
+					const auto volume = luaL_checknumber(L, 2);
+					luaL_argcheck(L, volume >= 0, 2, "volume must not be negative");
+					lua_pushboolean(L, reinterpret_cast<MixerControl*>(lua_touserdata(L, 1))->enqueue(MixerCommand::SET_VOLUME, (float)volume));
+					return 1;
+				}},
+				{"setPan", [](lua_State* L) -> int
+				{
+					const auto pan = luaL_checknumber(L, 2);
+					luaL_argcheck(L, pan >= -1 && pan <= 1, 2, "pan must be between -1 and 1");
+					lua_pushboolean(L, reinterpret_cast<MixerControl*>(lua_touserdata(L, 1))->enqueue(MixerCommand::SET_PAN, (float)pan));
+					return 1;
+				}},
+				{"getQueueStats", [](lua_State* L) -> int
+				{
+					auto& ctrl = *reinterpret_cast<MixerControl*>(lua_touserdata(L, 1));
+					const auto applied = ctrl.applied.load(std::memory_order_relaxed);
+					lua_newtable(L);
+					lua_pushinteger(L, (lua_Integer)ctrl.queue.size());
+					lua_setfield(L, -2, "pending");
+					lua_pushinteger(L, (lua_Integer)applied);
+					lua_setfield(L, -2, "applied");
+					lua_pushinteger(L, (lua_Integer)ctrl.overflows);
+					lua_setfield(L, -2, "overflows");
+					lua_pushnumber(L, applied ? (double)ctrl.latency_total_ns.load(std::memory_order_relaxed) / applied / 1000.0 : 0.0);
+					lua_setfield(L, -2, "avg_latency_us");
+					lua_pushnumber(L, (double)ctrl.latency_max_ns.load(std::memory_order_relaxed) / 1000.0);
+					lua_setfield(L, -2, "max_latency_us");
+					return 1;
+				}},
+				{"renderTo", [](lua_State* L) -> int
+				{
+					return tryCatch(L, [](lua_State* L)
+					{
+						auto& ctrl = *reinterpret_cast<MixerControl*>(lua_touserdata(L, 1));
+						if (ctrl.attached)
+						{
+							luaL_error(L, "cannot render a mixer that has an output");
+						}
+						const char* path = luaL_checkstring(L, 2);
+						const auto seconds = luaL_checknumber(L, 3);
+						luaL_argcheck(L, seconds >= 0, 3, "duration must not be negative");
+						const int channels = checkAudChannels(L, 4);
+						luaL_argcheck(L, seconds * AUD_SAMPLE_RATE <= (double)maxWavFrames(channels), 3, "duration too long for a WAV file");
+						const auto frames = (size_t)(seconds * AUD_SAMPLE_RATE);
+
+						std::ofstream out(path, std::ios::binary);
+						if (!out)
+						{
+							throw Exception(std::string("Failed to open ") + path);
+						}
+						writeWavHeader(out, frames, channels);
+						renderMixer(ctrl, frames, channels, [&out](const audSample* samples, size_t n)
+						{
+							out.write(reinterpret_cast<const char*>(samples), n * sizeof(audSample));
+						});
+						if (!out.flush())
+						{
+							throw Exception(std::string("Failed to write ") + path);
+						}
+						lua_pushinteger(L, (lua_Integer)frames);
+						return 1;
+					});
+				}},
+				{"renderToBuffer", [](lua_State* L) -> int
+				{
+					return tryCatch(L, [](lua_State* L)
+					{
+						auto& ctrl = *reinterpret_cast<MixerControl*>(lua_touserdata(L, 1));
+						if (ctrl.attached)
+						{
+							luaL_error(L, "cannot render a mixer that has an output");
+						}
+						const auto frames = luaL_checkinteger(L, 2);
+						luaL_argcheck(L, frames >= 0, 2, "number of frames must not be negative");
+						const int channels = checkAudChannels(L, 3);
+
+						std::string pcm{};
+						pcm.reserve((size_t)frames * channels * sizeof(audSample));
+						renderMixer(ctrl, (size_t)frames, channels, [&pcm](const audSample* samples, size_t n)
+						{
+							pcm.append(reinterpret_cast<const char*>(samples), n * sizeof(audSample));
+						});
+						pushContents(L, std::move(pcm), lua_toboolean(L, 4));
+						return 1;
+					});
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr luaL_Reg getters[] = {
+				{"stop_playback_when_done", [](lua_State* L) -> int
+				{
+					lua_pushboolean(L, reinterpret_cast<MixerControl*>(lua_touserdata(L, 1))->stop_playback_when_done);
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr luaL_Reg setters[] = {
+				{"stop_playback_when_done", [](lua_State* L) -> int
+				{
+					auto& ctrl = *reinterpret_cast<MixerControl*>(lua_touserdata(L, 1));
+					const bool value = lua_toboolean(L, 3);
+					if (ctrl.enqueue(MixerCommand::SET_STOP_PLAYBACK_WHEN_DONE, value ? 1.0f : 0.0f)) // on overflow, counted like any other command
+					{
+						// Only mirror what the audio thread will actually see.
+						ctrl.stop_playback_when_done = value;
+					}
+					return 0;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::audMixer",
+				.methods = methods,
+				.getters = getters,
+				.setters = setters,
+			};
+			return desc;
+		}
+
+		static int lua_audMixer(lua_State* L)
+		{
+			pushNewWithMt<MixerControl>(L, desc_audMixer());
+			return 1;
+		}
+
+		[[nodiscard]] static int checkAudChannels(lua_State* L, int i)
+		{
+			const auto channels = luaL_optinteger(L, i, 1);
+			luaL_argcheck(L, channels >= 1 && channels <= 8, i, "channel count must be between 1 and 8");
+			return (int)channels;
+		}
+
+		// Pulls blocks from the mixer through a playback that is not attached to any device, so rendering takes as long as the
+		// mixing does. Queued commands are applied between blocks, just like with a device. The sink receives interleaved samples.
+		template <typename F>
+		static void renderMixer(MixerControl& ctrl, size_t frames, int channels, F&& sink)
+		{
+			audPlayback pb;
+			pb.channels = channels;
+			ctrl.setOutput(pb);
+
+			ctrl.rendering_offline = true;
+			try
+			{
+				std::vector<audSample> block(AUD_BLOCK_SAMPLES);
+				for (size_t remaining = frames * channels; remaining != 0; )
+				{
+					pb.src(pb, block.data());
+					const auto n = std::min<size_t>(remaining, block.size());
+					sink(block.data(), n);
+					remaining -= n;
+				}
+			}
+			catch (...)
+			{
+				ctrl.rendering_offline = false;
+				throw;
+			}
+			ctrl.rendering_offline = false;
+		}
+
+		// RIFF sizes are 32-bit, and the RIFF size also covers the 36 bytes of header that follow it.
+		[[nodiscard]] static constexpr size_t maxWavFrames(int channels) noexcept
+		{
+			return (0xFFFFFFFF - 36) / (channels * sizeof(audSample));
+		}
+
+		static void writeWavHeader(std::ostream& out, size_t frames, int channels)
+		{
+			if (frames > maxWavFrames(channels))
+			{
+				throw Exception("Audio data is too large for a WAV file");
+			}
+			const auto put16 = [&out](uint16_t v)
+			{
+				const char b[2] = { (char)(v & 0xFF), (char)(v >> 8) };
+				out.write(b, sizeof(b));
+			};
+			const auto put32 = [&put16](uint32_t v)
+			{
+				put16((uint16_t)(v & 0xFFFF));
+				put16((uint16_t)(v >> 16));
+			};
+			const auto data_size = (uint32_t)(frames * channels * sizeof(audSample));
+			out.write("RIFF", 4);
+			put32(36 + data_size);
+			out.write("WAVEfmt ", 8);
+			put32(16); // fmt chunk size
+			put16(1); // PCM
+			put16((uint16_t)channels);
+			put32(AUD_SAMPLE_RATE);
+			put32((uint32_t)(AUD_SAMPLE_RATE * channels * sizeof(audSample))); // byte rate
+			put16((uint16_t)(channels * sizeof(audSample))); // block align
+			put16(sizeof(audSample) * 8); // bits per sample
+			out.write("data", 4);
+			put32(data_size);
+		}
+
+		static const TypeDesc& desc_audSound()
+		{
+			static constexpr TypeDesc desc{
+				.name = "soup::SharedPtr<soup::audSound>",
+			};
+			return desc;
+		}
+
+		static const TypeDesc& desc_audWav()
+		{
+			static constexpr luaL_Reg getters[] = {
+				{"channels", [](lua_State* L) -> int
+				{
+					lua_pushinteger(L, (*reinterpret_cast<SharedPtr<audWav>*>(lua_touserdata(L, 1)))->channels);
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::SharedPtr<soup::audWav>",
+				.base = &desc_audSound,
+				.getters = getters,
+			};
+			return desc;
+		}
+
+		static int lua_audWav(lua_State* L)
+		{
+			checkType(L, 1, desc_Reader());
+			return tryCatch(L, [](lua_State* L)
+			{
+				pushNewWithMt<SharedPtr<soup::audWav>>(L, desc_audWav(), soup::make_shared<audWav>(*reinterpret_cast<soup::Reader*>(lua_touserdata(L, 1))));
+
+				// Samples are read on demand, so keep the reader alive for as long as the userdata is.
+				lua_pushvalue(L, 1);
+				lua_setiuservalue(L, -2, 1);
+				return 1;
+			});
+		}
+#pragma endregion Lua API - Audio
+
+#pragma region Lua API - Net
+		static const FieldReg* getNetFields()
+		{
+			static constexpr luaL_Reg net_intel[] = {
+				{"getAsByIp", &lua_netIntel_getAsByIp},
+				{"getLocationByIp", &lua_netIntel_getLocationByIp},
+				{"enrich", &lua_netIntel_enrich},
+				{"setCacheSize", [](lua_State* L) -> int
+				{
+					const auto capacity = luaL_checkinteger(L, 1);
+					luaL_argcheck(L, capacity >= 0, 1, "cache size must not be negative");
+					getContext(L).net_intel_cache.setCapacity((size_t)capacity);
+					return 0;
+				}},
+				{"getCacheStats", [](lua_State* L) -> int
+				{
+					const auto stats = getContext(L).net_intel_cache.getStats();
+					lua_createtable(L, 0, 5);
+					lua_pushinteger(L, (lua_Integer)stats.hits);
+					lua_setfield(L, -2, "hits");
+					lua_pushinteger(L, (lua_Integer)stats.misses);
+					lua_setfield(L, -2, "misses");
+					lua_pushinteger(L, (lua_Integer)stats.evictions);
+					lua_setfield(L, -2, "evictions");
+					lua_pushinteger(L, (lua_Integer)stats.size);
+					lua_setfield(L, -2, "size");
+					lua_pushinteger(L, (lua_Integer)stats.capacity);
+					lua_setfield(L, -2, "capacity");
+					return 1;
+				}},
+				{"invalidateCache", [](lua_State* L) -> int
+				{
+					getContext(L).net_intel_cache.invalidate();
+					return 0;
+				}},
+				{"preload", [](lua_State* L) -> int
+				{
+					auto& src = *getContext(L).net_intel_source;
+					if (src.generation.load() == 0)
+					{
+						src.start(checkDataProvider(L));
+					}
+					return 0;
+				}},
+				{"isReady", [](lua_State* L) -> int
+				{
+					lua_pushboolean(L, getContext(L).net_intel_source->generation.load() != 0);
+					return 1;
+				}},
+				{"wait", [](lua_State* L) -> int
+				{
+					std::optional<std::chrono::milliseconds> timeout{};
+					if (!lua_isnoneornil(L, 1))
+					{
+						timeout = std::chrono::milliseconds(luaL_checkinteger(L, 1));
+					}
+					auto& src = *getContext(L).net_intel_source;
+					if (src.generation.load() == 0)
+					{
+						src.start(checkDataProvider(L));
+					}
+					if (!src.waitFor(timeout))
+					{
+						lua_pushboolean(L, false);
+						return 1;
+					}
+					if (src.state == NetIntelSource::FAILED)
+					{
+						luaL_where(L, 1);
+						pushString(L, src.getError());
+						lua_concat(L, 2);
+						lua_error(L);
+					}
+					lua_pushboolean(L, true);
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr FieldReg fields[] = {
+				{"netIntel", nullptr, net_intel},
+				{"getCountryName", &lua_getCountryName},
+				{"IpAddr", &lua_IpAddr},
+				{"resolveReverseDns", &lua_resolveReverseDns},
+				{"resolveReverseDnsBatch", &lua_resolveReverseDnsBatch},
+				{nullptr, nullptr},
+			};
+			return fields;
+		}
+
+		static const TypeDesc& desc_netAs()
+		{
+			static constexpr luaL_Reg methods[] = {
+				{"isValid", &lua_mm_isValid},
+				{"isHosting", [](lua_State* L) -> int
+				{
+					return tryCatch(L, [](lua_State* L)
+					{
+						auto intel = getContext(L).getNetIntelIfReady(L);
+						lua_pushboolean(L, intel && reinterpret_cast<netAs*>(lua_touserdata(L, 1))->isHosting(*intel));
+						return 1;
+					});
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr luaL_Reg getters[] = {
+				{"number", [](lua_State* L) -> int
+				{
+					lua_pushinteger(L, reinterpret_cast<netAs*>(lua_touserdata(L, 1))->number);
+					return 1;
+				}},
+				{"handle", [](lua_State* L) -> int
+				{
+					lua_pushstring(L, reinterpret_cast<netAs*>(lua_touserdata(L, 1))->handle);
+					return 1;
+				}},
+				{"name", [](lua_State* L) -> int
+				{
+					lua_pushstring(L, reinterpret_cast<netAs*>(lua_touserdata(L, 1))->name);
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::netAs",
+				.methods = methods,
+				.getters = getters,
+			};
+			return desc;
+		}
+
+		static int lua_netIntel_getAsByIp(lua_State* L)
+		{
+			return tryCatch(L, [](lua_State* L)
+			{
+				auto as = getContext(L).getAsByIp(L, checkIpAddr(L, 1));
+				if (!as)
+				{
+					return 0;
+				}
+				pushNewWithMt<netAs>(L, desc_netAs(), *as);
+				return 1;
+			});
+		}
+
+		static const TypeDesc& desc_netIntelLocationData()
+		{
+			static constexpr luaL_Reg methods[] = {
+				{"isValid", &lua_mm_isValid},
+				{nullptr, nullptr}
+			};
+			static constexpr luaL_Reg getters[] = {
+				{"city", [](lua_State* L) -> int
+				{
+					lua_pushstring(L, reinterpret_cast<netIntelLocationData*>(lua_touserdata(L, 1))->city);
+					return 1;
+				}},
+				{"state", [](lua_State* L) -> int
+				{
+					lua_pushstring(L, reinterpret_cast<netIntelLocationData*>(lua_touserdata(L, 1))->state);
+					return 1;
+				}},
+				{"country_code", [](lua_State* L) -> int
+				{
+					lua_pushstring(L, reinterpret_cast<netIntelLocationData*>(lua_touserdata(L, 1))->country_code.c_str());
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::netIntelLocationData",
+				.methods = methods,
+				.getters = getters,
+			};
+			return desc;
+		}
+
+		static int lua_netIntel_getLocationByIp(lua_State* L)
+		{
+			return tryCatch(L, [](lua_State* L)
+			{
+				auto location = getContext(L).getLocationByIp(L, checkIpAddr(L, 1));
+				if (!location)
+				{
+					return 0;
+				}
+				pushNewWithMt<netIntelLocationData>(L, desc_netIntelLocationData(), *location);
+				return 1;
+			});
+		}
+
+		// Like checkIpAddr for each element of the array at the given index, but throws instead of raising a Lua error.
+		[[nodiscard]] static std::vector<IpAddr> getIpAddrArray(lua_State* L, int i)
+		{
+			std::vector<IpAddr> ips(lua_rawlen(L, i));
+			for (size_t j = 0; j != ips.size(); ++j)
+			{
+				switch (lua_rawgeti(L, i, (lua_Integer)j + 1))
+				{
+				case LUA_TSTRING:
+					if (!ips[j].fromString(lua_tostring(L, -1)))
+					{
+						throw Exception("Invalid IP address at index " + std::to_string(j + 1));
+					}
+					break;
+
+				case LUA_TNUMBER:
+					{
+						int isnum;
+						const auto v = lua_tointegerx(L, -1, &isnum);
+						if (!isnum || v < 0 || v > 0xFFFFFFFF)
+						{
+							throw Exception("Invalid IP address at index " + std::to_string(j + 1));
+						}
+						ips[j] = IpAddr(native_u32_t((uint32_t)v));
+					}
+					break;
+
+				default:
+					if (!isType(L, -1, desc_IpAddr()))
+					{
+						throw Exception("Expected IP address at index " + std::to_string(j + 1));
+					}
+					ips[j] = *reinterpret_cast<IpAddr*>(lua_touserdata(L, -1));
+					break;
+				}
+				lua_pop(L, 1);
+			}
+			return ips;
+		}
+
+		// Looks up a whole array of IPs in one go and returns the results as one array per field, so there's no userdata per result.
+		static int lua_netIntel_enrich(lua_State* L)
+		{
+			return tryCatch(L, [](lua_State* L)
+			{
+				enum : uint8_t
+				{
+					FIELD_ASN,
+					FIELD_HANDLE,
+					FIELD_NAME,
+					FIELD_CITY,
+					FIELD_STATE,
+					FIELD_COUNTRY_CODE,
+					FIELD_COUNTRY_NAME,
+
+					NUM_FIELDS
+				};
+				static constexpr const char* field_names[NUM_FIELDS] = { "asn", "handle", "name", "city", "state", "country_code", "country_name" };
+
+				checkType(L, 1, LUA_TTABLE);
+				const char* language = luaL_optstring(L, 3, "EN");
+				std::vector<uint8_t> fields{};
+				if (lua_isnoneornil(L, 2))
+				{
+					fields = { FIELD_ASN, FIELD_HANDLE, FIELD_NAME, FIELD_CITY, FIELD_STATE, FIELD_COUNTRY_CODE, FIELD_COUNTRY_NAME };
+				}
+				else
+				{
+					checkType(L, 2, LUA_TTABLE);
+					for (lua_Integer i = 1; lua_rawgeti(L, 2, i) != LUA_TNIL; ++i)
+					{
+						const char* name = (lua_type(L, -1) == LUA_TSTRING ? lua_tostring(L, -1) : "");
+						const auto f = std::find_if(std::begin(field_names), std::end(field_names), [name](const char* fn)
+						{
+							return strcmp(name, fn) == 0;
+						});
+						if (f == std::end(field_names))
+						{
+							throw Exception(std::string("Unknown field: ") + name);
+						}
+						fields.emplace_back((uint8_t)(f - std::begin(field_names)));
+						lua_pop(L, 1);
+					}
+					lua_pop(L, 1);
+				}
+				const auto ips = getIpAddrArray(L, 1);
+				const auto n = ips.size();
+
+				bool need_as = false, need_location = false;
+				for (const auto f : fields)
+				{
+					(f <= FIELD_NAME ? need_as : need_location) = true;
+				}
+				auto& ctx = getContext(L);
+				const auto intel = ctx.getNetIntelIfReady(L);
+				auto& cache = ctx.net_intel_cache;
+				std::vector<const netAs*> as(need_as ? n : 0);
+				std::vector<const netIntelLocationData*> locations(need_location ? n : 0);
+				if (intel)
+				{
+					for (size_t i = 0; i != as.size(); ++i)
+					{
+						as[i] = cache.getAsByIp(*intel, ips[i]);
+					}
+					for (size_t i = 0; i != locations.size(); ++i)
+					{
+						locations[i] = cache.getLocationByIp(*intel, ips[i]);
+					}
+				}
+
+				lua_createtable(L, 0, (int)fields.size());
+				std::unordered_map<std::string, const char*> country_names{}; // few distinct countries, many IPs
+				for (const auto f : fields)
+				{
+					lua_createtable(L, (int)n, 0);
+					for (size_t i = 0; i != n; ++i)
+					{
+						const netAs* a = (f <= FIELD_NAME ? as[i] : nullptr);
+						const netIntelLocationData* loc = (f <= FIELD_NAME ? nullptr : locations[i]);
+						const char* str = nullptr;
+						switch (f)
+						{
+						case FIELD_ASN:
+							if (a)
+							{
+								lua_pushinteger(L, a->number);
+								lua_rawseti(L, -2, (lua_Integer)i + 1);
+								continue;
+							}
+							break;
+
+						case FIELD_HANDLE: str = (a ? a->handle : nullptr); break;
+						case FIELD_NAME: str = (a ? a->name : nullptr); break;
+						case FIELD_CITY: str = (loc ? loc->city : nullptr); break;
+						case FIELD_STATE: str = (loc ? loc->state : nullptr); break;
+						case FIELD_COUNTRY_CODE: str = (loc ? loc->country_code.c_str() : nullptr); break;
+
+						case FIELD_COUNTRY_NAME:
+							if (loc)
+							{
+								auto e = country_names.find(loc->country_code.c_str());
+								if (e == country_names.end())
+								{
+									e = country_names.emplace(loc->country_code.c_str(), getCountryName(loc->country_code.c_str(), language)).first;
+								}
+								str = e->second;
+							}
+							break;
+						}
+						if (str)
+						{
+							lua_pushstring(L, str);
+						}
+						else
+						{
+							lua_pushboolean(L, false); // keeps the column free of holes
+						}
+						lua_rawseti(L, -2, (lua_Integer)i + 1);
+					}
+					lua_setfield(L, -2, field_names[f]);
+				}
+				return 1;
+			});
+		}
+
+		static int lua_getCountryName(lua_State* L)
+		{
+			if (lua_gettop(L) >= 2)
+			{
+				pushString(L, getCountryName(luaL_checkstring(L, 1), luaL_checkstring(L, 2)));
+			}
+			else
+			{
+				pushString(L, getCountryName(luaL_checkstring(L, 1)));
+			}
+			return 1;
+		}
+
+		static const TypeDesc& desc_IpAddr()
+		{
+			static constexpr luaL_Reg methods[] = {
+				{"getReverseDns", [](lua_State* L) -> int
+				{
+					pushString(L, reinterpret_cast<IpAddr*>(lua_touserdata(L, 1))->getReverseDns());
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr luaL_Reg metamethods[] = {
+				{"__tostring", [](lua_State* L) -> int
+				{
+					pushString(L, reinterpret_cast<IpAddr*>(lua_touserdata(L, 1))->toString());
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::IpAddr",
+				.methods = methods,
+				.metamethods = metamethods,
+			};
+			return desc;
+		}
+
+		static int lua_IpAddr(lua_State* L)
+		{
+			pushNewWithMt<IpAddr>(L, desc_IpAddr(), checkIpAddr(L, 1));
+			return 1;
+		}
+
+		// getReverseDns blocks, so lookups run as IoJobs on the dns_pool. Its MAX_DNS_LOOKUPS workers bound how many are in flight
+		// across all states, and a lookup that nobody is waiting for anymore is skipped if it hasn't started yet.
+		[[nodiscard]] static SharedPtr<IoJob> makeReverseDnsJob(const IpAddr& ip, const std::shared_ptr<IoCompletionQueue>& completions)
+		{
+			return soup::make_shared<IoJob>([ip]
+			{
+				return ip.getReverseDns();
+			}, completions);
+		}
+
+		static void pushReverseDnsResult(lua_State* L, const IoJob& job)
+		{
+			if (!job.error.empty() || job.result.empty())
+			{
+				lua_pushboolean(L, false);
+			}
+			else
+			{
+				pushString(L, job.result);
+			}
+		}
+
+		static const TypeDesc& desc_ReverseDnsTask()
+		{
+			static constexpr luaL_Reg methods[] = {
+				{"isDone", [](lua_State* L) -> int
+				{
+					lua_pushboolean(L, reinterpret_cast<IoTask*>(lua_touserdata(L, 1))->job->isDone());
+					return 1;
+				}},
+				{"await", &lua_ReverseDnsTask_await},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::ReverseDnsTask",
+				.methods = methods,
+			};
+			return desc;
+		}
+
+		// Like IoTask:await, so the coroutine is resumed by soup.pumpIo once the lookup is done.
+		static int lua_ReverseDnsTask_await(lua_State* L)
+		{
+			checkType(L, 1, desc_ReverseDnsTask());
+			auto& job = *reinterpret_cast<IoTask*>(lua_touserdata(L, 1))->job;
+			if (awaitIoJob(L, job))
+			{
+				return lua_yieldk(L, 0, 0, [](lua_State* L, int, lua_KContext) -> int
+				{
+					lua_settop(L, 1);
+					return lua_ReverseDnsTask_await(L);
+				});
+			}
+			pushReverseDnsResult(L, job);
+			return 1;
+		}
+
+		static int lua_resolveReverseDns(lua_State* L)
+		{
+			return tryCatch(L, [](lua_State* L)
+			{
+				auto job = makeReverseDnsJob(checkIpAddr(L, 1), getContext(L).io_completions);
+				pushNewWithMt<IoTask>(L, desc_ReverseDnsTask(), job);
+				dns_pool().submit(std::move(job));
+				return 1;
+			});
+		}
+
+		// Blocks, so the lookups report to a completion queue of their own rather than the state's one that soup.pumpIo drains.
+		// concurrency only limits how many of this batch's lookups are queued at once; MAX_DNS_LOOKUPS limits how many run.
+		static int lua_resolveReverseDnsBatch(lua_State* L)
+		{
+			return tryCatch(L, [](lua_State* L)
+			{
+				checkType(L, 1, LUA_TTABLE);
+				size_t concurrency = 16;
+				std::optional<std::chrono::milliseconds> timeout{};
+				if (!lua_isnoneornil(L, 2))
+				{
+					checkType(L, 2, LUA_TTABLE);
+					if (lua_getfield(L, 2, "concurrency") != LUA_TNIL)
+					{
+						const auto n = luaL_checkinteger(L, -1);
+						luaL_argcheck(L, n > 0, 2, "concurrency must be at least 1");
+						concurrency = (size_t)n;
+					}
+					if (lua_getfield(L, 2, "timeout") != LUA_TNIL)
+					{
+						timeout = std::chrono::milliseconds(luaL_checkinteger(L, -1));
+					}
+					lua_pop(L, 2);
+				}
+
+				const auto ips = getIpAddrArray(L, 1);
+				const auto deadline = std::chrono::steady_clock::now() + timeout.value_or(std::chrono::milliseconds(0));
+				const auto completions = std::make_shared<IoCompletionQueue>();
+				std::vector<SharedPtr<IoJob>> jobs{};
+				jobs.reserve(ips.size());
+				std::unordered_map<const IoJob*, size_t> indices{};
+				std::vector<std::pair<size_t, SharedPtr<IoJob>>> finished{};
+				finished.reserve(ips.size());
+				while (finished.size() != ips.size())
+				{
+					for (; jobs.size() != ips.size() && jobs.size() - finished.size() < concurrency; )
+					{
+						auto job = makeReverseDnsJob(ips[jobs.size()], completions);
+						indices.emplace(job.get(), jobs.size());
+						jobs.emplace_back(job);
+						dns_pool().submit(std::move(job));
+					}
+					std::optional<std::chrono::milliseconds> remaining{};
+					if (timeout)
+					{
+						remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+						if (remaining->count() <= 0)
+						{
+							break;
+						}
+					}
+					if (!completions->waitFor(remaining))
+					{
+						break;
+					}
+					while (auto job = completions->pop())
+					{
+						const auto i = indices.at(job.get());
+						finished.emplace_back(i, std::move(job));
+					}
+				}
+				for (auto& job : jobs)
+				{
+					job->cancel(); // lookups still queued are skipped, and ones still running are discarded
+				}
+
+				lua_createtable(L, 0, (int)finished.size());
+				for (const auto& [i, job] : finished)
+				{
+					pushString(L, ips[i].toString());
+					pushReverseDnsResult(L, *job);
+					lua_rawset(L, -3);
+				}
+				return 1;
+			});
+		}
+#pragma endregion Lua API - Net
+
+#pragma region Lua API - Math
+		static const FieldReg* getMathFields()
+		{
+			static constexpr FieldReg fields[] = {
+				{"Matrix", &lua_Matrix},
+				{"Vector3", &lua_Vector3},
+				{"Vector3Array", &lua_Vector3Array},
+				{"TransformTree", &lua_TransformTree},
+				{nullptr, nullptr},
+			};
+			return fields;
+		}
+
+		static const TypeDesc& desc_Matrix()
+		{
+			static constexpr luaL_Reg methods[] = {
+				{"setPosRotXYZ", &lua_Matrix_setPosRotXYZ},
+				{"transformArray", &lua_Matrix_transformArray},
+				{"transformInto", [](lua_State* L) -> int
+				{
+					const Matrix& m = *reinterpret_cast<Matrix*>(lua_touserdata(L, 1));
+					const Vector3 v = checkVector3(L, 2);
+					checkVector3(L, 3) = (m * v);
+					lua_settop(L, 3);
+					return 1;
+				}},
+				{"inverse", [](lua_State* L) -> int
+				{
+					const Matrix res = reinterpret_cast<Matrix*>(lua_touserdata(L, 1))->inverse();
+					pushNewWithMt<Matrix>(L, desc_Matrix(), res);
+					return 1;
+				}},
+				{"getPosition", [](lua_State* L) -> int
+				{
+					*pushNewVector3(L) = (*reinterpret_cast<Matrix*>(lua_touserdata(L, 1)) * Vector3(0.0f, 0.0f, 0.0f));
+					return 1;
+				}},
+				{"getRotation", [](lua_State* L) -> int
+				{
+					*pushNewVector3(L) = reinterpret_cast<Matrix*>(lua_touserdata(L, 1))->getRotationXYZ();
+					return 1;
+				}},
+				{"transformXYZ", [](lua_State* L) -> int
+				{
+					const Matrix& m = *reinterpret_cast<Matrix*>(lua_touserdata(L, 1));
+					const Vector3 v = (m * Vector3((float)luaL_checknumber(L, 2), (float)luaL_checknumber(L, 3), (float)luaL_checknumber(L, 4)));
+					lua_pushnumber(L, v.x);
+					lua_pushnumber(L, v.y);
+					lua_pushnumber(L, v.z);
+					return 3;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr luaL_Reg metamethods[] = {
+				{"__mul", [](lua_State* L) -> int
+				{
+					checkType(L, 1, desc_Matrix());
+					Matrix& m = *reinterpret_cast<Matrix*>(lua_touserdata(L, 1));
+					if (isType(L, 2, desc_Matrix()))
+					{
+						const Matrix res = (m * *reinterpret_cast<Matrix*>(lua_touserdata(L, 2)));
+						pushNewWithMt<Matrix>(L, desc_Matrix(), res);
+						return 1;
+					}
+					*pushNewVector3(L) = (m * checkVector3(L, 2));
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::Matrix",
+				.methods = methods,
+				.metamethods = metamethods,
+			};
+			return desc;
+		}
+
+		static int lua_Matrix(lua_State* L)
+		{
+			pushNewWithMt<Matrix>(L, desc_Matrix());
+			return 1;
+		}
+
+		static int lua_Matrix_setPosRotXYZ(lua_State* L)
+		{
+			Vector3 pos, rot;
+			if (lua_gettop(L) == 3)
+			{
+				pos = checkVector3(L, 2);
+				rot = checkVector3(L, 3);
+			}
+			else
+			{
+				pos.x = (float)luaL_checknumber(L, 2);
+				pos.y = (float)luaL_checknumber(L, 3);
+				pos.z = (float)luaL_checknumber(L, 4);
+				rot.x = (float)luaL_checknumber(L, 5);
+				rot.y = (float)luaL_checknumber(L, 6);
+				rot.z = (float)luaL_checknumber(L, 7);
+			}
+			reinterpret_cast<Matrix*>(lua_touserdata(L, 1))->setPosRotXYZ(pos, rot);
+			return 0;
+		}
+
+		static int lua_Matrix_transformArray(lua_State* L)
+		{
+			checkType(L, 2, desc_Vector3Array());
+			const Matrix& m = *reinterpret_cast<Matrix*>(lua_touserdata(L, 1));
+			const Vector3Array& src = *reinterpret_cast<Vector3Array*>(lua_touserdata(L, 2));
+			Vector3Array* dst;
+			if (lua_isnoneornil(L, 3))
+			{
+				dst = pushNewWithMt<Vector3Array>(L, desc_Vector3Array());
+			}
+			else
+			{
+				checkType(L, 3, desc_Vector3Array());
+				dst = reinterpret_cast<Vector3Array*>(lua_touserdata(L, 3));
+				lua_settop(L, 3);
+			}
+			dst->resize(src.size());
+
+			// Derive the affine coefficients through Matrix's own operator so we don't depend on its memory layout.
+			const Vector3 t = m * Vector3(0.0f, 0.0f, 0.0f);
+			const Vector3 cx = m * Vector3(1.0f, 0.0f, 0.0f);
+			const Vector3 cy = m * Vector3(0.0f, 1.0f, 0.0f);
+			const Vector3 cz = m * Vector3(0.0f, 0.0f, 1.0f);
+			const float c[12] = {
+				cx.x - t.x, cy.x - t.x, cz.x - t.x, t.x,
+				cx.y - t.y, cy.y - t.y, cz.y - t.y, t.y,
+				cx.z - t.z, cy.z - t.z, cz.z - t.z, t.z,
+			};
+			transformSoA(c, src.x.data(), src.y.data(), src.z.data(), dst->x.data(), dst->y.data(), dst->z.data(), src.size());
+			return 1;
+		}
+
+		static const TypeDesc& desc_Vector3()
+		{
+			static constexpr luaL_Reg getters[] = {
+				{"x", [](lua_State* L) -> int
+				{
+					lua_pushnumber(L, reinterpret_cast<Vector3*>(lua_touserdata(L, 1))->x);
+					return 1;
+				}},
+				{"y", [](lua_State* L) -> int
+				{
+					lua_pushnumber(L, reinterpret_cast<Vector3*>(lua_touserdata(L, 1))->y);
+					return 1;
+				}},
+				{"z", [](lua_State* L) -> int
+				{
+					lua_pushnumber(L, reinterpret_cast<Vector3*>(lua_touserdata(L, 1))->z);
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr luaL_Reg setters[] = {
+				{"x", [](lua_State* L) -> int
+				{
+					reinterpret_cast<Vector3*>(lua_touserdata(L, 1))->x = (float)luaL_checknumber(L, 3);
+					return 0;
+				}},
+				{"y", [](lua_State* L) -> int
+				{
+					reinterpret_cast<Vector3*>(lua_touserdata(L, 1))->y = (float)luaL_checknumber(L, 3);
+					return 0;
+				}},
+				{"z", [](lua_State* L) -> int
+				{
+					reinterpret_cast<Vector3*>(lua_touserdata(L, 1))->z = (float)luaL_checknumber(L, 3);
+					return 0;
+				}},
+				{nullptr, nullptr}
+			};
+			// The methods modify the vector in-place and return it, so hot loops can avoid allocating temporaries.
+			static constexpr luaL_Reg methods[] = {
+				{"get", [](lua_State* L) -> int
+				{
+					const Vector3& v = *reinterpret_cast<Vector3*>(lua_touserdata(L, 1));
+					lua_pushnumber(L, v.x);
+					lua_pushnumber(L, v.y);
+					lua_pushnumber(L, v.z);
+					return 3;
+				}},
+				{"set", [](lua_State* L) -> int
+				{
+					Vector3& v = *reinterpret_cast<Vector3*>(lua_touserdata(L, 1));
+					if (lua_type(L, 2) == LUA_TUSERDATA)
+					{
+						v = checkVector3(L, 2);
+					}
+					else
+					{
+						v.x = (float)luaL_checknumber(L, 2);
+						v.y = (float)luaL_checknumber(L, 3);
+						v.z = (float)luaL_checknumber(L, 4);
+					}
+					lua_settop(L, 1);
+					return 1;
+				}},
+				{"add", [](lua_State* L) -> int
+				{
+					Vector3& v = *reinterpret_cast<Vector3*>(lua_touserdata(L, 1));
+					const Vector3& b = checkVector3(L, 2);
+					v.x += b.x;
+					v.y += b.y;
+					v.z += b.z;
+					lua_settop(L, 1);
+					return 1;
+				}},
+				{"sub", [](lua_State* L) -> int
+				{
+					Vector3& v = *reinterpret_cast<Vector3*>(lua_touserdata(L, 1));
+					const Vector3& b = checkVector3(L, 2);
+					v.x -= b.x;
+					v.y -= b.y;
+					v.z -= b.z;
+					lua_settop(L, 1);
+					return 1;
+				}},
+				{"scale", [](lua_State* L) -> int
+				{
+					Vector3& v = *reinterpret_cast<Vector3*>(lua_touserdata(L, 1));
+					const auto f = (float)luaL_checknumber(L, 2);
+					v.x *= f;
+					v.y *= f;
+					v.z *= f;
+					lua_settop(L, 1);
+					return 1;
+				}},
+				{"normalize", [](lua_State* L) -> int
+				{
+					Vector3& v = *reinterpret_cast<Vector3*>(lua_touserdata(L, 1));
+					if (const float len = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z); len != 0.0f)
+					{
+						v.x /= len;
+						v.y /= len;
+						v.z /= len;
+					}
+					lua_settop(L, 1);
+					return 1;
+				}},
+				{"dot", [](lua_State* L) -> int
+				{
+					const Vector3& v = *reinterpret_cast<Vector3*>(lua_touserdata(L, 1));
+					const Vector3& b = checkVector3(L, 2);
+					lua_pushnumber(L, v.x * b.x + v.y * b.y + v.z * b.z);
+					return 1;
+				}},
+				{"length", [](lua_State* L) -> int
+				{
+					const Vector3& v = *reinterpret_cast<Vector3*>(lua_touserdata(L, 1));
+					lua_pushnumber(L, std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z));
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr luaL_Reg metamethods[] = {
+				{"__add", [](lua_State* L) -> int
+				{
+					const Vector3& a = checkVector3(L, 1);
+					const Vector3& b = checkVector3(L, 2);
+					*pushNewVector3(L) = Vector3(a.x + b.x, a.y + b.y, a.z + b.z);
+					return 1;
+				}},
+				{"__sub", [](lua_State* L) -> int
+				{
+					const Vector3& a = checkVector3(L, 1);
+					const Vector3& b = checkVector3(L, 2);
+					*pushNewVector3(L) = Vector3(a.x - b.x, a.y - b.y, a.z - b.z);
+					return 1;
+				}},
+				{"__mul", [](lua_State* L) -> int
+				{
+					// Either operand may be the number.
+					const int vi = (lua_type(L, 1) == LUA_TNUMBER ? 2 : 1);
+					const Vector3& v = checkVector3(L, vi);
+					const auto f = (float)luaL_checknumber(L, 3 - vi);
+					*pushNewVector3(L) = Vector3(v.x * f, v.y * f, v.z * f);
+					return 1;
+				}},
+				{"__div", [](lua_State* L) -> int
+				{
+					const Vector3& v = checkVector3(L, 1);
+					const auto f = (float)luaL_checknumber(L, 2);
+					*pushNewVector3(L) = Vector3(v.x / f, v.y / f, v.z / f);
+					return 1;
+				}},
+				{"__unm", [](lua_State* L) -> int
+				{
+					const Vector3& v = *reinterpret_cast<Vector3*>(lua_touserdata(L, 1));
+					*pushNewVector3(L) = Vector3(-v.x, -v.y, -v.z);
+					return 1;
+				}},
+				{"__eq", [](lua_State* L) -> int
+				{
+					if (!isType(L, 1, desc_Vector3()) || !isType(L, 2, desc_Vector3()))
+					{
+						lua_pushboolean(L, false);
+						return 1;
+					}
+					const Vector3& a = *reinterpret_cast<Vector3*>(lua_touserdata(L, 1));
+					const Vector3& b = *reinterpret_cast<Vector3*>(lua_touserdata(L, 2));
+					lua_pushboolean(L, a.x == b.x && a.y == b.y && a.z == b.z);
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::Vector3",
+				.methods = methods,
+				.getters = getters,
+				.setters = setters,
+				.metamethods = metamethods,
+			};
+			return desc;
+		}
+
+		static int lua_Vector3(lua_State* L)
+		{
+			const auto args = lua_gettop(L);
+			auto v = pushNewVector3(L);
+			if (args >= 3)
+			{
+				v->x = (float)luaL_checknumber(L, 1);
+				v->y = (float)luaL_checknumber(L, 2);
+				v->z = (float)luaL_checknumber(L, 3);
+			}
+			return 1;
+		}
+
+		// Structure-of-arrays storage for many vectors so bulk operations can run SIMD-width strides of each component.
+		struct Vector3Array
+		{
+			std::vector<float> x{};
+			std::vector<float> y{};
+			std::vector<float> z{};
+
+			[[nodiscard]] size_t size() const noexcept
+			{
+				return x.size();
+			}
+
+			void resize(size_t size)
+			{
+				x.resize(size);
+				y.resize(size);
+				z.resize(size);
+			}
+		};
+
+		static const TypeDesc& desc_Vector3Array()
+		{
+			static constexpr luaL_Reg methods[] = {
+				{"get", [](lua_State* L) -> int
+				{
+					auto& arr = *reinterpret_cast<Vector3Array*>(lua_touserdata(L, 1));
+					const size_t i = checkVector3ArrayIndex(L, 2, arr);
+					lua_pushnumber(L, arr.x[i]);
+					lua_pushnumber(L, arr.y[i]);
+					lua_pushnumber(L, arr.z[i]);
+					return 3;
+				}},
+				{"set", [](lua_State* L) -> int
+				{
+					auto& arr = *reinterpret_cast<Vector3Array*>(lua_touserdata(L, 1));
+					const size_t i = checkVector3ArrayIndex(L, 2, arr);
+					if (lua_type(L, 3) == LUA_TUSERDATA)
+					{
+						const Vector3& v = checkVector3(L, 3);
+						arr.x[i] = v.x;
+						arr.y[i] = v.y;
+						arr.z[i] = v.z;
+					}
+					else
+					{
+						arr.x[i] = (float)luaL_checknumber(L, 3);
+						arr.y[i] = (float)luaL_checknumber(L, 4);
+						arr.z[i] = (float)luaL_checknumber(L, 5);
+					}
+					return 0;
+				}},
+				{"resize", [](lua_State* L) -> int
+				{
+					const auto size = luaL_checkinteger(L, 2);
+					luaL_argcheck(L, size >= 0, 2, "size must not be negative");
+					reinterpret_cast<Vector3Array*>(lua_touserdata(L, 1))->resize((size_t)size);
+					return 0;
+				}},
+				{"add", [](lua_State* L) -> int
+				{
+					auto& arr = *reinterpret_cast<Vector3Array*>(lua_touserdata(L, 1));
+					checkType(L, 2, desc_Vector3Array());
+					const auto& other = *reinterpret_cast<Vector3Array*>(lua_touserdata(L, 2));
+					luaL_argcheck(L, other.size() == arr.size(), 2, "size mismatch");
+					addSoA(arr.x.data(), other.x.data(), arr.size());
+					addSoA(arr.y.data(), other.y.data(), arr.size());
+					addSoA(arr.z.data(), other.z.data(), arr.size());
+					lua_settop(L, 1);
+					return 1;
+				}},
+				{"scale", [](lua_State* L) -> int
+				{
+					auto& arr = *reinterpret_cast<Vector3Array*>(lua_touserdata(L, 1));
+					const auto f = (float)luaL_checknumber(L, 2);
+					scaleSoA(arr.x.data(), f, arr.size());
+					scaleSoA(arr.y.data(), f, arr.size());
+					scaleSoA(arr.z.data(), f, arr.size());
+					lua_settop(L, 1);
+					return 1;
+				}},
+				{"dot", [](lua_State* L) -> int
+				{
+					const auto& arr = *reinterpret_cast<Vector3Array*>(lua_touserdata(L, 1));
+					checkType(L, 2, desc_Vector3Array());
+					const auto& other = *reinterpret_cast<Vector3Array*>(lua_touserdata(L, 2));
+					luaL_argcheck(L, other.size() == arr.size(), 2, "size mismatch");
+					std::vector<float> res(arr.size());
+					dotSoA(arr.x.data(), arr.y.data(), arr.z.data(), other.x.data(), other.y.data(), other.z.data(), res.data(), arr.size());
+					pushNumberArray(L, res);
+					return 1;
+				}},
+				{"length", [](lua_State* L) -> int
+				{
+					const auto& arr = *reinterpret_cast<Vector3Array*>(lua_touserdata(L, 1));
+					std::vector<float> res(arr.size());
+					dotSoA(arr.x.data(), arr.y.data(), arr.z.data(), arr.x.data(), arr.y.data(), arr.z.data(), res.data(), arr.size());
+					sqrtSoA(res.data(), res.size());
+					pushNumberArray(L, res);
+					return 1;
+				}},
+				{"min", [](lua_State* L) -> int
+				{
+					const auto& arr = *reinterpret_cast<Vector3Array*>(lua_touserdata(L, 1));
+					if (arr.size() == 0)
+					{
+						return 0;
+					}
+					lua_pushnumber(L, reduceSoA<false>(arr.x.data(), arr.size()));
+					lua_pushnumber(L, reduceSoA<false>(arr.y.data(), arr.size()));
+					lua_pushnumber(L, reduceSoA<false>(arr.z.data(), arr.size()));
+					return 3;
+				}},
+				{"max", [](lua_State* L) -> int
+				{
+					const auto& arr = *reinterpret_cast<Vector3Array*>(lua_touserdata(L, 1));
+					if (arr.size() == 0)
+					{
+						return 0;
+					}
+					lua_pushnumber(L, reduceSoA<true>(arr.x.data(), arr.size()));
+					lua_pushnumber(L, reduceSoA<true>(arr.y.data(), arr.size()));
+					lua_pushnumber(L, reduceSoA<true>(arr.z.data(), arr.size()));
+					return 3;
+				}},
+				{"fromTable", [](lua_State* L) -> int
+				{
+					checkVector3ArrayFromTable(L, 2, *reinterpret_cast<Vector3Array*>(lua_touserdata(L, 1)));
+					return 0;
+				}},
+				{"toTable", [](lua_State* L) -> int
+				{
+					const auto& arr = *reinterpret_cast<Vector3Array*>(lua_touserdata(L, 1));
+					lua_createtable(L, (int)(arr.size() * 3), 0);
+					for (size_t i = 0; i != arr.size(); ++i)
+					{
+						lua_pushnumber(L, arr.x[i]);
+						lua_rawseti(L, -2, (i * 3) + 1);
+						lua_pushnumber(L, arr.y[i]);
+						lua_rawseti(L, -2, (i * 3) + 2);
+						lua_pushnumber(L, arr.z[i]);
+						lua_rawseti(L, -2, (i * 3) + 3);
+					}
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr luaL_Reg metamethods[] = {
+				{"__len", [](lua_State* L) -> int
+				{
+					lua_pushinteger(L, reinterpret_cast<Vector3Array*>(lua_touserdata(L, 1))->size());
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::Vector3Array",
+				.methods = methods,
+				.metamethods = metamethods,
+			};
+			return desc;
+		}
+
+		static int lua_Vector3Array(lua_State* L)
+		{
+			auto arr = pushNewWithMt<Vector3Array>(L, desc_Vector3Array());
+			if (lua_type(L, 1) == LUA_TTABLE)
+			{
+				checkVector3ArrayFromTable(L, 1, *arr);
+			}
+			else if (!lua_isnoneornil(L, 1))
+			{
+				const auto size = luaL_checkinteger(L, 1);
+				luaL_argcheck(L, size >= 0, 1, "size must not be negative");
+				arr->resize((size_t)size);
+			}
+			return 1;
+		}
+
+		[[nodiscard]] static size_t checkVector3ArrayIndex(lua_State* L, int i, const Vector3Array& arr)
+		{
+			const auto idx = luaL_checkinteger(L, i);
+			luaL_argcheck(L, idx >= 1 && (size_t)idx <= arr.size(), i, "index out of bounds");
+			return (size_t)(idx - 1);
+		}
+
+		// Reads a flat array of numbers ({x1, y1, z1, x2, y2, z2, ...}) into the array.
+		static void checkVector3ArrayFromTable(lua_State* L, int i, Vector3Array& arr)
+		{
+			luaL_checktype(L, i, LUA_TTABLE);
+			const auto len = (size_t)lua_rawlen(L, i);
+			luaL_argcheck(L, (len % 3) == 0, i, "number of elements must be a multiple of 3");
+			arr.resize(len / 3);
+			for (size_t j = 0; j != arr.size(); ++j)
+			{
+				lua_rawgeti(L, i, (j * 3) + 1);
+				lua_rawgeti(L, i, (j * 3) + 2);
+				lua_rawgeti(L, i, (j * 3) + 3);
+				arr.x[j] = (float)luaL_checknumber(L, -3);
+				arr.y[j] = (float)luaL_checknumber(L, -2);
+				arr.z[j] = (float)luaL_checknumber(L, -1);
+				lua_pop(L, 3);
+			}
+		}
+
+		static void pushNumberArray(lua_State* L, const std::vector<float>& arr)
+		{
+			lua_createtable(L, (int)arr.size(), 0);
+			for (size_t i = 0; i != arr.size(); ++i)
+			{
+				lua_pushnumber(L, arr[i]);
+				lua_rawseti(L, -2, i + 1);
+			}
+		}
+
+		// A hierarchy of transforms, kept in arrays where parents come before their children. That way, world matrices can be
+		// brought up to date in a single pass which only recomputes nodes whose local transform or parent changed.
+		struct TransformTree
+		{
+			std::vector<int32_t> parents{}; // -1 for roots
+			std::vector<Vector3> positions{};
+			std::vector<Vector3> rotations{};
+			std::vector<Matrix> worlds{};
+			std::vector<uint8_t> dirty{}; // local transform changed since the last update
+			std::vector<uint8_t> changed{}; // world matrix was recomputed in the current update
+
+			[[nodiscard]] size_t size() const noexcept
+			{
+				return parents.size();
+			}
+
+			size_t add(int32_t parent, const Vector3& pos, const Vector3& rot)
+			{
+				parents.emplace_back(parent);
+				positions.emplace_back(pos);
+				rotations.emplace_back(rot);
+				worlds.emplace_back();
+				dirty.emplace_back(true);
+				changed.emplace_back(false);
+				return size() - 1;
+			}
+
+			void setLocal(size_t i, const Vector3& pos, const Vector3& rot) noexcept
+			{
+				positions[i] = pos;
+				rotations[i] = rot;
+				dirty[i] = true;
+			}
+
+			// Returns the number of world matrices that were recomputed.
+			size_t update()
+			{
+				size_t n = 0;
+				for (size_t i = 0; i != size(); ++i)
+				{
+					const auto parent = parents[i];
+					changed[i] = (dirty[i] || (parent >= 0 && changed[parent]));
+					if (changed[i])
+					{
+						Matrix local;
+						local.setPosRotXYZ(positions[i], rotations[i]);
+						worlds[i] = (parent >= 0 ? worlds[parent] * local : local);
+						dirty[i] = false;
+						++n;
+					}
+				}
+				return n;
+			}
+		};
+
+		static const TypeDesc& desc_TransformTree()
+		{
+			static constexpr luaL_Reg methods[] = {
+				{"add", [](lua_State* L) -> int
+				{
+					auto& tree = *reinterpret_cast<TransformTree*>(lua_touserdata(L, 1));
+					int32_t parent = -1;
+					if (!lua_isnoneornil(L, 2) && luaL_checkinteger(L, 2) != 0)
+					{
+						parent = (int32_t)checkTransformTreeIndex(L, 2, tree);
+					}
+					Vector3 pos, rot;
+					if (!lua_isnoneornil(L, 3))
+					{
+						pos = checkVector3(L, 3);
+					}
+					if (!lua_isnoneornil(L, 4))
+					{
+						rot = checkVector3(L, 4);
+					}
+					lua_pushinteger(L, (lua_Integer)tree.add(parent, pos, rot) + 1);
+					return 1;
+				}},
+				{"getParent", [](lua_State* L) -> int
+				{
+					auto& tree = *reinterpret_cast<TransformTree*>(lua_touserdata(L, 1));
+					lua_pushinteger(L, tree.parents[checkTransformTreeIndex(L, 2, tree)] + 1);
+					return 1;
+				}},
+				{"setLocal", [](lua_State* L) -> int
+				{
+					auto& tree = *reinterpret_cast<TransformTree*>(lua_touserdata(L, 1));
+					const auto i = checkTransformTreeIndex(L, 2, tree);
+					if (lua_type(L, 3) == LUA_TUSERDATA)
+					{
+						tree.setLocal(i, checkVector3(L, 3), checkVector3(L, 4));
+					}
+					else
+					{
+						tree.setLocal(i,
+							Vector3((float)luaL_checknumber(L, 3), (float)luaL_checknumber(L, 4), (float)luaL_checknumber(L, 5)),
+							Vector3((float)luaL_checknumber(L, 6), (float)luaL_checknumber(L, 7), (float)luaL_checknumber(L, 8))
+						);
+					}
+					return 0;
+				}},
+				{"setLocalArrays", [](lua_State* L) -> int
+				{
+					auto& tree = *reinterpret_cast<TransformTree*>(lua_touserdata(L, 1));
+					checkType(L, 2, desc_Vector3Array());
+					checkType(L, 3, desc_Vector3Array());
+					const auto& pos = *reinterpret_cast<Vector3Array*>(lua_touserdata(L, 2));
+					const auto& rot = *reinterpret_cast<Vector3Array*>(lua_touserdata(L, 3));
+					luaL_argcheck(L, pos.size() == tree.size(), 2, "size must match the number of nodes");
+					luaL_argcheck(L, rot.size() == tree.size(), 3, "size must match the number of nodes");
+					for (size_t i = 0; i != tree.size(); ++i)
+					{
+						tree.setLocal(i, Vector3(pos.x[i], pos.y[i], pos.z[i]), Vector3(rot.x[i], rot.y[i], rot.z[i]));
+					}
+					return 0;
+				}},
+				{"update", [](lua_State* L) -> int
+				{
+					lua_pushinteger(L, (lua_Integer)reinterpret_cast<TransformTree*>(lua_touserdata(L, 1))->update());
+					return 1;
+				}},
+				{"getWorldMatrix", [](lua_State* L) -> int
+				{
+					auto& tree = *reinterpret_cast<TransformTree*>(lua_touserdata(L, 1));
+					const auto i = checkTransformTreeIndex(L, 2, tree);
+					tree.update();
+					pushNewWithMt<Matrix>(L, desc_Matrix(), tree.worlds[i]);
+					return 1;
+				}},
+				{"getWorldPositions", [](lua_State* L) -> int
+				{
+					auto& tree = *reinterpret_cast<TransformTree*>(lua_touserdata(L, 1));
+					Vector3Array* dst;
+					if (lua_isnoneornil(L, 2))
+					{
+						dst = pushNewWithMt<Vector3Array>(L, desc_Vector3Array());
+					}
+					else
+					{
+						checkType(L, 2, desc_Vector3Array());
+						dst = reinterpret_cast<Vector3Array*>(lua_touserdata(L, 2));
+						lua_settop(L, 2);
+					}
+					tree.update();
+					dst->resize(tree.size());
+					for (size_t i = 0; i != tree.size(); ++i)
+					{
+						const Vector3 p = (tree.worlds[i] * Vector3(0.0f, 0.0f, 0.0f));
+						dst->x[i] = p.x;
+						dst->y[i] = p.y;
+						dst->z[i] = p.z;
+					}
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr luaL_Reg metamethods[] = {
+				{"__len", [](lua_State* L) -> int
+				{
+					lua_pushinteger(L, (lua_Integer)reinterpret_cast<TransformTree*>(lua_touserdata(L, 1))->size());
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::TransformTree",
+				.methods = methods,
+				.metamethods = metamethods,
+			};
+			return desc;
+		}
+
+		static int lua_TransformTree(lua_State* L)
+		{
+			pushNewWithMt<TransformTree>(L, desc_TransformTree());
+			return 1;
+		}
+
+		[[nodiscard]] static size_t checkTransformTreeIndex(lua_State* L, int i, const TransformTree& tree)
+		{
+			const auto idx = luaL_checkinteger(L, i);
+			luaL_argcheck(L, idx >= 1 && (size_t)idx <= tree.size(), i, "node index out of bounds");
+			return (size_t)(idx - 1);
+		}
+#pragma endregion Lua API - Math
+
+#pragma region SIMD Kernels
+		// The widest vector type the compiler was told it may use; the kernels' main loops go this many floats at a time.
+#if SOUP_X86 && defined(__AVX__)
+		using simd_float = __m256;
+		static constexpr size_t SIMD_WIDTH = 8;
+		[[nodiscard]] static simd_float simd_load(const float* p) noexcept { return _mm256_loadu_ps(p); }
+		static void simd_store(float* p, simd_float a) noexcept { _mm256_storeu_ps(p, a); }
+		[[nodiscard]] static simd_float simd_set1(float f) noexcept { return _mm256_set1_ps(f); }
+		[[nodiscard]] static simd_float simd_add(simd_float a, simd_float b) noexcept { return _mm256_add_ps(a, b); }
+		[[nodiscard]] static simd_float simd_mul(simd_float a, simd_float b) noexcept { return _mm256_mul_ps(a, b); }
+		[[nodiscard]] static simd_float simd_min(simd_float a, simd_float b) noexcept { return _mm256_min_ps(a, b); }
+		[[nodiscard]] static simd_float simd_max(simd_float a, simd_float b) noexcept { return _mm256_max_ps(a, b); }
+		[[nodiscard]] static simd_float simd_sqrt(simd_float a) noexcept { return _mm256_sqrt_ps(a); }
+#elif SOUP_X86
+		using simd_float = __m128;
+		static constexpr size_t SIMD_WIDTH = 4;
+		[[nodiscard]] static simd_float simd_load(const float* p) noexcept { return _mm_loadu_ps(p); }
+		static void simd_store(float* p, simd_float a) noexcept { _mm_storeu_ps(p, a); }
+		[[nodiscard]] static simd_float simd_set1(float f) noexcept { return _mm_set1_ps(f); }
+		[[nodiscard]] static simd_float simd_add(simd_float a, simd_float b) noexcept { return _mm_add_ps(a, b); }
+		[[nodiscard]] static simd_float simd_mul(simd_float a, simd_float b) noexcept { return _mm_mul_ps(a, b); }
+		[[nodiscard]] static simd_float simd_min(simd_float a, simd_float b) noexcept { return _mm_min_ps(a, b); }
+		[[nodiscard]] static simd_float simd_max(simd_float a, simd_float b) noexcept { return _mm_max_ps(a, b); }
+		[[nodiscard]] static simd_float simd_sqrt(simd_float a) noexcept { return _mm_sqrt_ps(a); }
+#else
+		using simd_float = float;
+		static constexpr size_t SIMD_WIDTH = 1;
+		[[nodiscard]] static simd_float simd_load(const float* p) noexcept { return *p; }
+		static void simd_store(float* p, simd_float a) noexcept { *p = a; }
+		[[nodiscard]] static simd_float simd_set1(float f) noexcept { return f; }
+		[[nodiscard]] static simd_float simd_add(simd_float a, simd_float b) noexcept { return a + b; }
+		[[nodiscard]] static simd_float simd_mul(simd_float a, simd_float b) noexcept { return a * b; }
+		[[nodiscard]] static simd_float simd_min(simd_float a, simd_float b) noexcept { return std::min(a, b); }
+		[[nodiscard]] static simd_float simd_max(simd_float a, simd_float b) noexcept { return std::max(a, b); }
+		[[nodiscard]] static simd_float simd_sqrt(simd_float a) noexcept { return std::sqrt(a); }
+#endif
+
+		// c is a row-major 3x4 affine matrix. Source and destination may be the same arrays.
+		static void transformSoA(const float c[12], const float* sx, const float* sy, const float* sz, float* dx, float* dy, float* dz, size_t n) noexcept
+		{
+			size_t i = 0;
+			if (n >= SIMD_WIDTH)
+			{
+				simd_float vc[12];
+				for (size_t j = 0; j != 12; ++j)
+				{
+					vc[j] = simd_set1(c[j]);
+				}
+				for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH)
+				{
+					const auto x = simd_load(&sx[i]);
+					const auto y = simd_load(&sy[i]);
+					const auto z = simd_load(&sz[i]);
+					simd_store(&dx[i], simd_add(simd_add(simd_mul(vc[0], x), simd_mul(vc[1], y)), simd_add(simd_mul(vc[2], z), vc[3])));
+					simd_store(&dy[i], simd_add(simd_add(simd_mul(vc[4], x), simd_mul(vc[5], y)), simd_add(simd_mul(vc[6], z), vc[7])));
+					simd_store(&dz[i], simd_add(simd_add(simd_mul(vc[8], x), simd_mul(vc[9], y)), simd_add(simd_mul(vc[10], z), vc[11])));
+				}
+			}
+			for (; i != n; ++i)
+			{
+				const float x = sx[i], y = sy[i], z = sz[i];
+				dx[i] = (c[0] * x + c[1] * y) + (c[2] * z + c[3]);
+				dy[i] = (c[4] * x + c[5] * y) + (c[6] * z + c[7]);
+				dz[i] = (c[8] * x + c[9] * y) + (c[10] * z + c[11]);
+			}
+		}
+
+		static void addSoA(float* dst, const float* src, size_t n) noexcept
+		{
+			size_t i = 0;
+			for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH)
+			{
+				simd_store(&dst[i], simd_add(simd_load(&dst[i]), simd_load(&src[i])));
+			}
+			for (; i != n; ++i)
+			{
+				dst[i] += src[i];
+			}
+		}
+
+		static void scaleSoA(float* dst, float f, size_t n) noexcept
+		{
+			size_t i = 0;
+			const auto vf = simd_set1(f);
+			for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH)
+			{
+				simd_store(&dst[i], simd_mul(simd_load(&dst[i]), vf));
+			}
+			for (; i != n; ++i)
+			{
+				dst[i] *= f;
+			}
+		}
+
+		static void dotSoA(const float* ax, const float* ay, const float* az, const float* bx, const float* by, const float* bz, float* out, size_t n) noexcept
+		{
+			size_t i = 0;
+			for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH)
+			{
+				simd_store(&out[i], simd_add(simd_add(simd_mul(simd_load(&ax[i]), simd_load(&bx[i])), simd_mul(simd_load(&ay[i]), simd_load(&by[i]))), simd_mul(simd_load(&az[i]), simd_load(&bz[i]))));
+			}
+			for (; i != n; ++i)
+			{
+				out[i] = (ax[i] * bx[i] + ay[i] * by[i]) + az[i] * bz[i];
+			}
+		}
+
+		static void sqrtSoA(float* dst, size_t n) noexcept
+		{
+			size_t i = 0;
+			for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH)
+			{
+				simd_store(&dst[i], simd_sqrt(simd_load(&dst[i])));
+			}
+			for (; i != n; ++i)
+			{
+				dst[i] = std::sqrt(dst[i]);
+			}
+		}
+
+		// n must not be 0.
+		template <bool max>
+		[[nodiscard]] static float reduceSoA(const float* src, size_t n) noexcept
+		{
+			float res = src[0];
+			size_t i = 0;
+			if (n >= SIMD_WIDTH)
+			{
+				auto acc = simd_load(&src[0]);
+				for (i = SIMD_WIDTH; i + SIMD_WIDTH <= n; i += SIMD_WIDTH)
+				{
+					acc = (max ? simd_max(acc, simd_load(&src[i])) : simd_min(acc, simd_load(&src[i])));
+				}
+				float lanes[SIMD_WIDTH];
+				simd_store(lanes, acc);
+				for (const float f : lanes)
+				{
+					res = (max ? std::max(res, f) : std::min(res, f));
+				}
+			}
+			for (; i != n; ++i)
+			{
+				res = (max ? std::max(res, src[i]) : std::min(res, src[i]));
+			}
+			return res;
+		}
+#pragma endregion SIMD Kernels
+
+#pragma region Lua API - I/O
+		static const FieldReg* getIoFields()
+		{
+			static constexpr FieldReg fields[] = {
+				{"FileReader", &lua_FileReader},
+				{"MappedFileReader", &lua_MappedFileReader},
+				{"StringReader", &lua_StringReader},
+				{"Buffer", &lua_Buffer},
+				{"ZipReader", &lua_ZipReader},
+				{"ZipWriter", &lua_ZipWriter},
+				{"readFileAsync", &lua_readFileAsync},
+				{"pumpIo", &lua_pumpIo},
+				{"waitIo", &lua_waitIo},
+				{nullptr, nullptr},
+			};
+			return fields;
+		}
+
+		static const TypeDesc& desc_Reader()
+		{
+			static constexpr TypeDesc desc{
+				.name = "soup::Reader",
+			};
+			return desc;
+		}
+
+		static const TypeDesc& desc_FileReader()
+		{
+			static constexpr TypeDesc desc{
+				.name = "soup::FileReader",
+				.base = &desc_Reader,
+			};
+			return desc;
+		}
+
+		static int lua_FileReader(lua_State* L)
+		{
+			pushNewWithMt<FileReader>(L, desc_FileReader(), luaL_checkstring(L, 1));
+
+			// Remember the path, so async reads can open the file on their own instead of sharing the reader across threads.
+			lua_pushvalue(L, 1);
+			lua_setiuservalue(L, -2, 1);
+			return 1;
+		}
+
+		// A reader over memory owned by something else. Bare instances keep the owner alive through their first user value.
+		static const TypeDesc& desc_MemoryRefReader()
+		{
+			static constexpr TypeDesc desc{
+				.name = "soup::MemoryRefReader",
+				.base = &desc_Reader,
+			};
+			return desc;
+		}
+
+		// Owns the mapping of a whole file. soup.MappedFileReader returns a MemoryRefReader over it, so seeking is free and
+		// reads are copies out of the page cache.
+		struct FileMapping
+		{
+			void* addr = nullptr;
+			size_t len = 0;
+
+			explicit FileMapping(const std::filesystem::path& path)
+			{
+				if (std::filesystem::file_size(path) != 0) // empty files can't be mapped
+				{
+					addr = filesystem::createFileMapping(path, len);
+					if (!addr)
+					{
+						throw Exception("Failed to map file");
+					}
+				}
+			}
+
+			FileMapping(const FileMapping&) = delete;
+			FileMapping& operator=(const FileMapping&) = delete;
+
+			~FileMapping()
+			{
+				if (addr)
+				{
+					filesystem::destroyFileMapping(addr, len);
+				}
+			}
+
+			// A hint for the kernel's readahead; a no-op where madvise is not available.
+			void advise([[maybe_unused]] int advice) const noexcept
+			{
+#if !SOUP_WINDOWS
+				if (addr)
+				{
+					posix_madvise(addr, len, advice);
+				}
+#endif
+			}
+
+			[[nodiscard]] static int checkAdvice(lua_State* L, int i)
+			{
+				static constexpr const char* const names[] = { "normal", "sequential", "random", "willneed", "dontneed", nullptr };
+#if SOUP_WINDOWS
+				return luaL_checkoption(L, i, nullptr, names);
+#else
+				static constexpr int values[] = { POSIX_MADV_NORMAL, POSIX_MADV_SEQUENTIAL, POSIX_MADV_RANDOM, POSIX_MADV_WILLNEED, POSIX_MADV_DONTNEED };
+				return values[luaL_checkoption(L, i, nullptr, names)];
+#endif
+			}
+		};
+
+		static const TypeDesc& desc_FileMapping()
+		{
+			static constexpr TypeDesc desc{
+				.name = "soup::FileMapping",
+			};
+			return desc;
+		}
+
+		static const TypeDesc& desc_MappedFileReader()
+		{
+			static constexpr luaL_Reg methods[] = {
+				{"advise", [](lua_State* L) -> int
+				{
+					const auto advice = FileMapping::checkAdvice(L, 2);
+					lua_getiuservalue(L, 1, 1);
+					reinterpret_cast<const FileMapping*>(lua_touserdata(L, -1))->advise(advice);
+					lua_settop(L, 1);
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::MappedFileReader",
+				.base = &desc_MemoryRefReader,
+				.methods = methods,
+			};
+			return desc;
+		}
+
+		static int lua_MappedFileReader(lua_State* L)
+		{
+			return tryCatch(L, [](lua_State* L)
+			{
+				const char* path = luaL_checkstring(L, 1);
+				const int advice = lua_isnoneornil(L, 2) ? -1 : FileMapping::checkAdvice(L, 2);
+				auto mapping = pushNewWithMt<FileMapping>(L, desc_FileMapping(), path);
+				if (advice != -1)
+				{
+					mapping->advise(advice);
+				}
+				pushNewWithMt<MemoryRefReader>(L, desc_MappedFileReader(), mapping->addr, mapping->len);
+				lua_insert(L, -2);
+				lua_setiuservalue(L, -2, 1);
+				return 1;
+			});
+		}
+
+		static const TypeDesc& desc_StringReader()
+		{
+			static constexpr TypeDesc desc{
+				.name = "soup::StringReader",
+				.base = &desc_Reader,
+			};
+			return desc;
+		}
+
+		struct BufferStorage
+		{
+			std::string bytes;
+			std::atomic_uint32_t pins = 0; // while non-zero, a worker may be reading the bytes, so they can't be modified
+
+			explicit BufferStorage(std::string&& bytes)
+				: bytes(std::move(bytes))
+			{
+			}
+		};
+
+		// Keeps a buffer's bytes from being modified while it is alive.
+		class BufferPin
+		{
+		public:
+			SharedPtr<BufferStorage> storage{};
+
+			BufferPin() = default;
+
+			explicit BufferPin(SharedPtr<BufferStorage> storage)
+				: storage(std::move(storage))
+			{
+				++this->storage->pins;
+			}
+
+			BufferPin(BufferPin&& b) noexcept
+				: storage(std::move(b.storage))
+			{
+			}
+
+			BufferPin& operator=(BufferPin&& b) noexcept
+			{
+				release();
+				storage = std::move(b.storage);
+				return *this;
+			}
+
+			~BufferPin()
+			{
+				release();
+			}
+
+			void release() noexcept
+			{
+				if (storage)
+				{
+					--storage->pins;
+					storage.reset();
+				}
+			}
+		};
+
+		// A view of a refcounted, mutable byte array. Slices share the bytes with the buffer they were taken from.
+		struct BufferView
+		{
+			SharedPtr<BufferStorage> storage;
+			size_t offset;
+			size_t size;
+
+			BufferView(SharedPtr<BufferStorage> storage, size_t offset, size_t size)
+				: storage(std::move(storage)), offset(offset), size(size)
+			{
+			}
+
+			[[nodiscard]] uint8_t* data() const noexcept
+			{
+				return reinterpret_cast<uint8_t*>(storage->bytes.data()) + offset;
+			}
+
+			[[nodiscard]] uint8_t* mutableData(lua_State* L) const
+			{
+				if (storage->pins != 0)
+				{
+					luaL_error(L, "buffer can't be modified while a ZipWriter is adding it");
+				}
+				return data();
+			}
+		};
+
+		static const TypeDesc& desc_Buffer()
+		{
+			static constexpr luaL_Reg methods[] = {
+				{"slice", [](lua_State* L) -> int
+				{
+					const auto& buf = *reinterpret_cast<BufferView*>(lua_touserdata(L, 1));
+					const auto [i, j] = checkBufferRange(L, 2, buf.size);
+					pushNewWithMt<BufferView>(L, desc_Buffer(), buf.storage, buf.offset + i, j - i);
+					return 1;
+				}},
+				{"toString", [](lua_State* L) -> int
+				{
+					const auto& buf = *reinterpret_cast<BufferView*>(lua_touserdata(L, 1));
+					const auto [i, j] = checkBufferRange(L, 2, buf.size);
+					lua_pushlstring(L, reinterpret_cast<const char*>(buf.data()) + i, j - i);
+					return 1;
+				}},
+				{"getInt", [](lua_State* L) -> int
+				{
+					const auto& buf = *reinterpret_cast<BufferView*>(lua_touserdata(L, 1));
+					const auto width = checkIntWidth(L, 3);
+					const auto pos = checkBufferPos(L, 2, buf.size, width);
+					const bool is_signed = lua_toboolean(L, 4);
+					const bool big_endian = lua_toboolean(L, 5);
+					uint64_t v = 0;
+					for (size_t k = 0; k != width; ++k)
+					{
+						v |= (uint64_t)buf.data()[pos + (big_endian ? width - 1 - k : k)] << (k * 8);
+					}
+					if (is_signed && width != 8 && (v >> (width * 8 - 1)))
+					{
+						v |= (~uint64_t(0) << (width * 8)); // sign-extend
+					}
+					lua_pushinteger(L, (lua_Integer)v);
+					return 1;
+				}},
+				{"setInt", [](lua_State* L) -> int
+				{
+					const auto& buf = *reinterpret_cast<BufferView*>(lua_touserdata(L, 1));
+					const auto v = (uint64_t)luaL_checkinteger(L, 3);
+					const auto width = checkIntWidth(L, 4);
+					const auto pos = checkBufferPos(L, 2, buf.size, width);
+					const bool big_endian = lua_toboolean(L, 5);
+					for (size_t k = 0; k != width; ++k)
+					{
+						buf.mutableData(L)[pos + (big_endian ? width - 1 - k : k)] = (uint8_t)(v >> (k * 8));
+					}
+					return 0;
+				}},
+				{"write", [](lua_State* L) -> int
+				{
+					const auto& buf = *reinterpret_cast<BufferView*>(lua_touserdata(L, 1));
+					const uint8_t* data;
+					size_t len;
+					if (isType(L, 3, desc_Buffer()))
+					{
+						const auto& src = *reinterpret_cast<BufferView*>(lua_touserdata(L, 3));
+						data = src.data();
+						len = src.size;
+					}
+					else
+					{
+						data = reinterpret_cast<const uint8_t*>(luaL_checklstring(L, 3, &len));
+					}
+					const auto pos = checkBufferPos(L, 2, buf.size, len);
+					memmove(buf.mutableData(L) + pos, data, len); // the source may be a slice of the same bytes
+					return 0;
+				}},
+				{"fill", [](lua_State* L) -> int
+				{
+					const auto& buf = *reinterpret_cast<BufferView*>(lua_touserdata(L, 1));
+					memset(buf.mutableData(L), (int)luaL_optinteger(L, 2, 0), buf.size);
+					return 0;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr luaL_Reg metamethods[] = {
+				{"__len", [](lua_State* L) -> int
+				{
+					lua_pushinteger(L, (lua_Integer)reinterpret_cast<BufferView*>(lua_touserdata(L, 1))->size);
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::Buffer",
+				.methods = methods,
+				.metamethods = metamethods,
+			};
+			return desc;
+		}
+
+		// Takes ownership of the data, so results produced in C++ become buffers without being copied.
+		static void pushBuffer(lua_State* L, std::string&& data)
+		{
+			const auto size = data.size();
+			pushNewWithMt<BufferView>(L, desc_Buffer(), soup::make_shared<BufferStorage>(std::move(data)), size_t(0), size);
+		}
+
+		// Frees the data either way, as it's not needed anymore once it's in Lua.
+		static void pushContents(lua_State* L, std::string&& data, bool as_buffer)
+		{
+			if (as_buffer)
+			{
+				pushBuffer(L, std::move(data));
+			}
+			else
+			{
+				pushString(L, data);
+				std::string().swap(data);
+			}
+		}
+
+		static int lua_Buffer(lua_State* L)
+		{
+			if (lua_type(L, 1) == LUA_TNUMBER)
+			{
+				const auto size = luaL_checkinteger(L, 1);
+				luaL_argcheck(L, size >= 0, 1, "size must not be negative");
+				pushBuffer(L, std::string((size_t)size, '\0'));
+				return 1;
+			}
+			pushBuffer(L, checkString(L, 1));
+			return 1;
+		}
+
+		// Same rules as string.sub: 1-based, inclusive, negative indices count from the end. Returns a 0-based half-open range.
+		[[nodiscard]] static std::pair<size_t, size_t> checkBufferRange(lua_State* L, int i, size_t size)
+		{
+			auto first = luaL_optinteger(L, i, 1);
+			auto last = luaL_optinteger(L, i + 1, -1);
+			if (first < 0)
+			{
+				first = std::max<lua_Integer>((lua_Integer)size + first + 1, 1);
+			}
+			else if (first == 0)
+			{
+				first = 1;
+			}
+			if (last < 0)
+			{
+				last = (lua_Integer)size + last + 1;
+			}
+			else if (last > (lua_Integer)size)
+			{
+				last = (lua_Integer)size;
+			}
+			if (first > last)
+			{
+				return { 0, 0 };
+			}
+			return { (size_t)first - 1, (size_t)last };
+		}
+
+		// Returns the 0-based position of `len` bytes starting at the 1-based index at i.
+		[[nodiscard]] static size_t checkBufferPos(lua_State* L, int i, size_t size, size_t len)
+		{
+			const auto pos = luaL_checkinteger(L, i);
+			luaL_argcheck(L, pos >= 1 && (size_t)pos - 1 <= size && len <= size - ((size_t)pos - 1), i, "out of bounds");
+			return (size_t)pos - 1;
+		}
+
+		[[nodiscard]] static size_t checkIntWidth(lua_State* L, int i)
+		{
+			const auto width = luaL_optinteger(L, i, 1);
+			luaL_argcheck(L, width == 1 || width == 2 || width == 4 || width == 8, i, "width must be 1, 2, 4 or 8");
+			return (size_t)width;
+		}
+
+		static int lua_StringReader(lua_State* L)
+		{
+			if (isType(L, 1, desc_Buffer()))
+			{
+				// Buffers are refcounted, so there is no need to copy them; the reader just keeps this view alive.
+				const auto& buf = *reinterpret_cast<BufferView*>(lua_touserdata(L, 1));
+				pushNewWithMt<MemoryRefReader>(L, desc_MemoryRefReader(), buf.data(), buf.size);
+				lua_pushvalue(L, 1);
+				lua_setiuservalue(L, -2, 1);
+				return 1;
+			}
+			if (lua_isboolean(L, 2) && !lua_toboolean(L, 2))
+			{
+				// Lua strings are immutable, so we can read straight from the string's buffer as long as we keep it alive.
+				size_t len;
+				const char* data = luaL_checklstring(L, 1, &len);
+				pushNewWithMt<MemoryRefReader>(L, desc_MemoryRefReader(), data, len);
+				lua_pushvalue(L, 1);
+				lua_setiuservalue(L, -2, 1);
+				return 1;
+			}
+			pushNewWithMt<StringReader>(L, desc_StringReader(), checkString(L, 1));
+			return 1;
+		}
+
+		static const TypeDesc& desc_ZipReader()
+		{
+			static constexpr luaL_Reg methods[] = {
+				{"getFileList", &lua_ZipReader_getFileList},
+				{"getFileContents", &lua_ZipReader_getFileContents},
+				{"open", &lua_ZipReader_open},
+				{"view", &lua_ZipReader_view},
+				{"find", [](lua_State* L) -> int
+				{
+					return tryCatch(L, [](lua_State* L)
+					{
+						auto f = reinterpret_cast<IndexedZipReader*>(lua_touserdata(L, 1))->find(luaL_checkstring(L, 2));
+						if (!f)
+						{
+							return 0;
+						}
+						pushZipEntry(L, *f);
+						return 1;
+					});
+				}},
+				{"contains", [](lua_State* L) -> int
+				{
+					return tryCatch(L, [](lua_State* L)
+					{
+						lua_pushboolean(L, reinterpret_cast<IndexedZipReader*>(lua_touserdata(L, 1))->find(luaL_checkstring(L, 2)) != nullptr);
+						return 1;
+					});
+				}},
+				{"getFileContentsAsync", &lua_ZipReader_getFileContentsAsync},
+				{"extractMany", &lua_ZipReader_extractMany},
+				{"extractAllTo", &lua_ZipReader_extractAllTo},
+				{"entries", [](lua_State* L) -> int
+				{
+					lua_pushcfunction(L, [](lua_State* L) -> int
+					{
+						return tryCatch(L, [](lua_State* L)
+						{
+							const auto& files = reinterpret_cast<IndexedZipReader*>(lua_touserdata(L, 1))->getIndexedFiles();
+							const auto i = lua_tointeger(L, 2);
+							if (i < 0 || (size_t)i >= files.size())
+							{
+								return 0;
+							}
+							lua_pushinteger(L, i + 1);
+							pushZipEntry(L, files[i]);
+							return 2;
+						});
+					});
+					lua_pushvalue(L, 1);
+					lua_pushinteger(L, 0);
+					return 3;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::ZipReader",
+				.methods = methods,
+			};
+			return desc;
+		}
+
+		// Parses the central directory once, on first use, and keeps a name index into it.
+		struct IndexedZipReader : public ZipReader
+		{
+			std::vector<ZipIndexedFile> files{};
+			std::unordered_map<std::string_view, size_t> by_name{};
+			std::unordered_map<uint32_t, size_t> by_offset{};
+			bool indexed = false;
+			const MemoryRefReader* memory = nullptr; // set if the reader is memory-backed, which allows for zero-copy views
+
+			using ZipReader::ZipReader;
+
+			const std::vector<ZipIndexedFile>& getIndexedFiles()
+			{
+				if (!indexed)
+				{
+					files = getFileList();
+					by_name.reserve(files.size());
+					by_offset.reserve(files.size());
+					for (size_t i = 0; i != files.size(); ++i)
+					{
+						by_name.emplace(files[i].name, i);
+						by_offset.emplace(files[i].offset, i);
+					}
+					indexed = true;
+				}
+				return files;
+			}
+
+			[[nodiscard]] const ZipIndexedFile* find(std::string_view name)
+			{
+				getIndexedFiles();
+				if (auto e = by_name.find(name); e != by_name.end())
+				{
+					return &files[e->second];
+				}
+				return nullptr;
+			}
+
+			[[nodiscard]] const ZipIndexedFile* findByOffset(uint32_t offset)
+			{
+				getIndexedFiles();
+				if (auto e = by_offset.find(offset); e != by_offset.end())
+				{
+					return &files[e->second];
+				}
+				return nullptr;
+			}
+
+			struct EntryData
+			{
+				size_t offset;
+				size_t compressed_size;
+				uint16_t compression_method;
+				bool sizes_in_descriptor;
+				uint32_t crc;
+			};
+
+			// Reads the local file header at the given offset to find where the entry's data is.
+			[[nodiscard]] EntryData locateData(uint32_t offset)
+			{
+				auto data = locateData(is, offset);
+				if (const auto f = findByOffset(offset))
+				{
+					// The central directory is authoritative, and it has the sizes even if they're in a data descriptor after the data.
+					data.compressed_size = f->compressed_size;
+					data.crc = f->uncompressed_data_crc32;
+				}
+				else if (data.sizes_in_descriptor)
+				{
+					data.compressed_size = 0;
+				}
+				return data;
+			}
+
+			// Works with any reader over the ZIP file, so it can be used off the Lua thread with a reader of its own. If
+			// `sizes_in_descriptor` is set, compressed_size and crc need to be taken from the central directory.
+			[[nodiscard]] static EntryData locateData(Reader& is, uint32_t offset)
+			{
+				uint8_t hdr[30];
+				is.seek(offset);
+				if (!is.raw(hdr, sizeof(hdr))
+					|| (hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) | ((uint32_t)hdr[3] << 24)) != 0x04034b50
+					)
+				{
+					throw Exception("No local file header at the given offset");
+				}
+				const uint16_t flags = (hdr[6] | (hdr[7] << 8));
+				EntryData data;
+				data.offset = offset + sizeof(hdr) + (hdr[26] | (hdr[27] << 8)) + (hdr[28] | (hdr[29] << 8));
+				data.compressed_size = (hdr[18] | (hdr[19] << 8) | (hdr[20] << 16) | ((uint32_t)hdr[21] << 24));
+				data.compression_method = (hdr[8] | (hdr[9] << 8));
+				data.sizes_in_descriptor = (flags & (1 << 3));
+				data.crc = (hdr[14] | (hdr[15] << 8) | (hdr[16] << 16) | ((uint32_t)hdr[17] << 24));
+				return data;
+			}
+
+			[[nodiscard]] static std::string readCompressed(Reader& is, const EntryData& data)
+			{
+				std::string compressed(data.compressed_size, '\0');
+				is.seek(data.offset);
+				if (!is.raw(compressed.data(), compressed.size()))
+				{
+					throw Exception("Failed to read compressed data");
+				}
+				return compressed;
+			}
+
+			[[nodiscard]] static std::string decompress(const EntryData& data, std::string&& compressed, size_t uncompressed_size)
+			{
+				if (data.compression_method == ZipEntryStream::METHOD_STORED)
+				{
+					ZipEntryStream::checkCrc(crc32::hash(reinterpret_cast<const uint8_t*>(compressed.data()), compressed.size()), data.crc);
+					return std::move(compressed);
+				}
+				StringReader sr(std::move(compressed));
+				ZipEntryStream stream(sr, 0, data.compressed_size, data.compression_method, data.crc);
+				stream.pending.reserve(uncompressed_size);
+				return stream.read(SIZE_MAX);
+			}
+		};
+
+		static int lua_ZipReader(lua_State* L)
+		{
+			checkType(L, 1, desc_Reader());
+			auto zr = pushNewWithMt<IndexedZipReader>(L, desc_ZipReader(), *reinterpret_cast<soup::Reader*>(lua_touserdata(L, 1)));
+			if (isType(L, 1, desc_MemoryRefReader()))
+			{
+				zr->memory = reinterpret_cast<const MemoryRefReader*>(lua_touserdata(L, 1));
+			}
+
+			// Keep the reader alive for as long as the ZipReader is.
+			lua_pushvalue(L, 1);
+			lua_setiuservalue(L, -2, 1);
+			return 1;
+		}
+
+		static int lua_ZipReader_getFileList(lua_State* L)
+		{
+			return tryCatch(L, [](lua_State* L)
+			{
+				const auto& files = reinterpret_cast<IndexedZipReader*>(lua_touserdata(L, 1))->getIndexedFiles();
+				lua_createtable(L, (int)files.size(), 0);
+				lua_Integer i = 1;
+				for (const auto& f : files)
+				{
+					pushZipEntry(L, f);
+					lua_rawseti(L, -2, i++);
+				}
+				return 1;
+			});
+		}
+
+		static void pushZipEntry(lua_State* L, const ZipIndexedFile& f)
+		{
+			lua_createtable(L, 0, 6);
+			pushString(L, f.name);
+			lua_setfield(L, -2, "name");
+			lua_pushinteger(L, f.offset);
+			lua_setfield(L, -2, "offset");
+			lua_pushinteger(L, f.compressed_size);
+			lua_setfield(L, -2, "compressed_size");
+			lua_pushinteger(L, f.uncompressed_size);
+			lua_setfield(L, -2, "uncompressed_size");
+			lua_pushinteger(L, f.compression_method);
+			lua_setfield(L, -2, "compression_method");
+			lua_pushinteger(L, f.uncompressed_data_crc32);
+			lua_setfield(L, -2, "crc32");
+		}
+
+		static int lua_ZipReader_getFileContents(lua_State* L)
+		{
+			return tryCatch(L, [](lua_State* L)
+			{
+				const auto offset = checkZipEntryOffset(L, 2);
+				pushContents(L, reinterpret_cast<soup::ZipReader*>(lua_touserdata(L, 1))->getFileContents(offset), lua_toboolean(L, 3));
+				return 1;
+			});
+		}
+
+		// Accepts an entry from getFileList or its offset.
+		[[nodiscard]] static uint32_t checkZipEntryOffset(lua_State* L, int i)
+		{
+			uint32_t offset;
+			if (lua_type(L, i) == LUA_TTABLE)
+			{
+				if (lua_getfield(L, i, "offset"))
+				{
+					offset = (uint32_t)luaL_checkinteger(L, -1);
+					lua_pop(L, 1);
+				}
+				else
+				{
+					offset = (uint32_t)luaL_checkinteger(L, i);
+				}
+			}
+			else
+			{
+				offset = (uint32_t)luaL_checkinteger(L, i);
+			}
+			return offset;
+		}
+
+		// Decompresses a single ZIP entry on demand, so memory use is bounded by the deflate window plus what the caller asks for,
+		// regardless of the entry's size. Positions the underlying reader itself on every refill, so several streams (or the
+		// ZipReader itself) can use the same reader interleaved.
+		struct ZipEntryStream
+		{
+			static constexpr uint16_t METHOD_STORED = 0;
+			static constexpr uint16_t METHOD_DEFLATE = 8;
+			static constexpr int MAX_BITS = 15;
+			static constexpr size_t WINDOW_SIZE = 0x8000;
+
+			static constexpr uint16_t LEN_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+			static constexpr uint8_t LEN_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+			static constexpr uint16_t DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+			static constexpr uint8_t DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+			static constexpr uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+			enum State : uint8_t
+			{
+				BLOCK_HEADER,
+				STORED_BLOCK,
+				HUFFMAN_BLOCK,
+				DONE,
+			};
+
+			struct Huffman
+			{
+				int16_t count[MAX_BITS + 1];
+				int16_t symbol[288];
+			};
+
+			Reader& is;
+			size_t in_pos;
+			size_t in_remaining;
+			std::array<uint8_t, 0x1000> in_buf;
+			size_t in_buf_pos = 0;
+			size_t in_buf_len = 0;
+			uint32_t bit_buf = 0;
+			int bit_count = 0;
+
+			State state;
+			bool last_block = false;
+			size_t stored_remaining = 0;
+			Huffman lencode;
+			Huffman distcode;
+
+			std::vector<uint8_t> window;
+			size_t total_out = 0;
+			std::string pending{};
+			uint32_t crc = 0; // of what has been returned by read so far
+			uint32_t expected_crc;
+
+			ZipEntryStream(Reader& is, size_t data_offset, size_t compressed_size, uint16_t method, uint32_t expected_crc)
+				: is(is), in_pos(data_offset), in_remaining(compressed_size), window(WINDOW_SIZE), expected_crc(expected_crc)
+			{
+				if (method == METHOD_STORED)
+				{
+					state = STORED_BLOCK;
+					last_block = true;
+					stored_remaining = compressed_size;
+				}
+				else if (method == METHOD_DEFLATE)
+				{
+					state = BLOCK_HEADER;
+				}
+				else
+				{
+					throw Exception("Unsupported compression method");
+				}
+			}
+
+			[[nodiscard]] bool isDone() const noexcept
+			{
+				return state == DONE && pending.empty();
+			}
+
+			static void checkCrc(uint32_t crc, uint32_t expected_crc)
+			{
+				if (crc != expected_crc)
+				{
+					throw Exception("CRC mismatch; the entry is corrupt");
+				}
+			}
+
+			// Returns up to max_bytes of decompressed data; an empty string means the end of the entry has been reached. Raises
+			// instead of returning the last of the data if it doesn't match the entry's CRC.
+			[[nodiscard]] std::string read(size_t max_bytes)
+			{
+				while (pending.size() < max_bytes && state != DONE)
+				{
+					step(max_bytes - pending.size());
+				}
+				std::string res;
+				if (pending.size() <= max_bytes)
+				{
+					res = std::move(pending);
+					pending.clear();
+				}
+				else
+				{
+					res = pending.substr(0, max_bytes);
+					pending.erase(0, max_bytes);
+				}
+				crc = crc32::hash(reinterpret_cast<const uint8_t*>(res.data()), res.size(), crc);
+				if (isDone())
+				{
+					checkCrc(crc, expected_crc);
+				}
+				return res;
+			}
+
+		private:
+			void step(size_t want)
+			{
+				switch (state)
+				{
+				case BLOCK_HEADER:
+					last_block = bits(1);
+					switch (bits(2))
+					{
+					case 0:
+						{
+							bit_buf = 0;
+							bit_count = 0;
+							const uint16_t len = (nextByte() | (nextByte() << 8));
+							const uint16_t nlen = (nextByte() | (nextByte() << 8));
+							if (len != (uint16_t)~nlen)
+							{
+								throw Exception("Corrupt stored block");
+							}
+							stored_remaining = len;
+							state = STORED_BLOCK;
+						}
+						break;
+
+					case 1:
+						setFixedTables();
+						state = HUFFMAN_BLOCK;
+						break;
+
+					case 2:
+						readDynamicTables();
+						state = HUFFMAN_BLOCK;
+						break;
+
+					default:
+						throw Exception("Invalid block type");
+					}
+					break;
+
+				case STORED_BLOCK:
+					for (size_t n = std::min(want, stored_remaining); n != 0; --n, --stored_remaining)
+					{
+						output(nextByte());
+					}
+					if (stored_remaining == 0)
+					{
+						state = (last_block ? DONE : BLOCK_HEADER);
+					}
+					break;
+
+				case HUFFMAN_BLOCK:
+					// Decode until we have what was asked for; a match may overshoot it by up to 257 bytes.
+					for (size_t produced = 0; produced < want; )
+					{
+						int symbol = decode(lencode);
+						if (symbol < 256)
+						{
+							output((uint8_t)symbol);
+							++produced;
+						}
+						else if (symbol == 256)
+						{
+							state = (last_block ? DONE : BLOCK_HEADER);
+							break;
+						}
+						else
+						{
+							symbol -= 257;
+							if (symbol >= 29)
+							{
+								throw Exception("Invalid length symbol");
+							}
+							size_t len = LEN_BASE[symbol] + bits(LEN_EXTRA[symbol]);
+							symbol = decode(distcode);
+							if (symbol >= 30)
+							{
+								throw Exception("Invalid distance symbol");
+							}
+							const size_t dist = DIST_BASE[symbol] + bits(DIST_EXTRA[symbol]);
+							if (dist > total_out)
+							{
+								throw Exception("Distance too far back");
+							}
+							produced += len;
+							for (; len != 0; --len)
+							{
+								output(window[(total_out - dist) & (WINDOW_SIZE - 1)]);
+							}
+						}
+					}
+					break;
+
+				case DONE:
+					break;
+				}
+			}
+
+			void output(uint8_t b)
+			{
+				window[total_out++ & (WINDOW_SIZE - 1)] = b;
+				pending.push_back((char)b);
+			}
+
+			[[nodiscard]] uint8_t nextByte()
+			{
+				if (in_buf_pos == in_buf_len)
+				{
+					if (in_remaining == 0)
+					{
+						throw Exception("Unexpected end of compressed data");
+					}
+					in_buf_len = std::min(in_buf.size(), in_remaining);
+					in_buf_pos = 0;
+					is.seek(in_pos);
+					if (!is.raw(in_buf.data(), in_buf_len))
+					{
+						throw Exception("Failed to read compressed data");
+					}
+					in_pos += in_buf_len;
+					in_remaining -= in_buf_len;
+				}
+				return in_buf[in_buf_pos++];
+			}
+
+			[[nodiscard]] uint32_t bits(int need)
+			{
+				while (bit_count < need)
+				{
+					bit_buf |= ((uint32_t)nextByte() << bit_count);
+					bit_count += 8;
+				}
+				const uint32_t val = (bit_buf & ((1u << need) - 1));
+				bit_buf >>= need;
+				bit_count -= need;
+				return val;
+			}
+
+			// Canonical Huffman decoding, one bit at a time.
+			[[nodiscard]] int decode(const Huffman& h)
+			{
+				int code = 0;
+				int first = 0;
+				int index = 0;
+				for (int len = 1; len <= MAX_BITS; ++len)
+				{
+					code |= bits(1);
+					const int count = h.count[len];
+					if (code - count < first)
+					{
+						return h.symbol[index + (code - first)];
+					}
+					index += count;
+					first += count;
+					first <<= 1;
+					code <<= 1;
+				}
+				throw Exception("Invalid Huffman code");
+			}
+
+			// Returns 0 for a complete code, a positive number for an incomplete code, or a negative number for an over-subscribed code.
+			static int construct(Huffman& h, const int16_t* lengths, int n)
+			{
+				std::fill(std::begin(h.count), std::end(h.count), 0);
+				for (int symbol = 0; symbol != n; ++symbol)
+				{
+					++h.count[lengths[symbol]];
+				}
+				if (h.count[0] == n)
+				{
+					return 0;
+				}
+				int left = 1;
+				for (int len = 1; len <= MAX_BITS; ++len)
+				{
+					left <<= 1;
+					left -= h.count[len];
+					if (left < 0)
+					{
+						return left;
+					}
+				}
+				int16_t offs[MAX_BITS + 1];
+				offs[1] = 0;
+				for (int len = 1; len < MAX_BITS; ++len)
+				{
+					offs[len + 1] = offs[len] + h.count[len];
+				}
+				for (int symbol = 0; symbol != n; ++symbol)
+				{
+					if (lengths[symbol] != 0)
+					{
+						h.symbol[offs[lengths[symbol]]++] = (int16_t)symbol;
+					}
+				}
+				return left;
+			}
+
+			void setFixedTables()
+			{
+				int16_t lengths[288];
+				int symbol = 0;
+				for (; symbol != 144; ++symbol) lengths[symbol] = 8;
+				for (; symbol != 256; ++symbol) lengths[symbol] = 9;
+				for (; symbol != 280; ++symbol) lengths[symbol] = 7;
+				for (; symbol != 288; ++symbol) lengths[symbol] = 8;
+				construct(lencode, lengths, 288);
+				for (symbol = 0; symbol != 30; ++symbol) lengths[symbol] = 5;
+				construct(distcode, lengths, 30);
+			}
+
+			void readDynamicTables()
+			{
+				const int nlen = bits(5) + 257;
+				const int ndist = bits(5) + 1;
+				const int ncode = bits(4) + 4;
+				if (nlen > 286 || ndist > 30)
+				{
+					throw Exception("Bad dynamic block counts");
+				}
+
+				int16_t lengths[286 + 30];
+				int index = 0;
+				for (; index != ncode; ++index)
+				{
+					lengths[CODE_LENGTH_ORDER[index]] = (int16_t)bits(3);
+				}
+				for (; index != 19; ++index)
+				{
+					lengths[CODE_LENGTH_ORDER[index]] = 0;
+				}
+				if (construct(lencode, lengths, 19) != 0)
+				{
+					throw Exception("Incomplete code length code");
+				}
+
+				for (index = 0; index < nlen + ndist; )
+				{
+					int symbol = decode(lencode);
+					if (symbol < 16)
+					{
+						lengths[index++] = (int16_t)symbol;
+						continue;
+					}
+					int16_t len = 0;
+					if (symbol == 16)
+					{
+						if (index == 0)
+						{
+							throw Exception("Repeat with no previous length");
+						}
+						len = lengths[index - 1];
+						symbol = 3 + bits(2);
+					}
+					else if (symbol == 17)
+					{
+						symbol = 3 + bits(3);
+					}
+					else
+					{
+						symbol = 11 + bits(7);
+					}
+					if (index + symbol > nlen + ndist)
+					{
+						throw Exception("Too many code lengths");
+					}
+					while (symbol--)
+					{
+						lengths[index++] = len;
+					}
+				}
+				if (lengths[256] == 0)
+				{
+					throw Exception("Missing end-of-block code");
+				}
+
+				int err = construct(lencode, lengths, nlen);
+				if (err < 0 || (err > 0 && nlen != lencode.count[0] + lencode.count[1]))
+				{
+					throw Exception("Bad literal/length code");
+				}
+				err = construct(distcode, lengths + nlen, ndist);
+				if (err < 0 || (err > 0 && ndist != distcode.count[0] + distcode.count[1]))
+				{
+					throw Exception("Bad distance code");
+				}
+			}
+		};
+
+		static const TypeDesc& desc_ZipEntryStream()
+		{
+			static constexpr luaL_Reg methods[] = {
+				{"read", [](lua_State* L) -> int
+				{
+					return tryCatch(L, [](lua_State* L)
+					{
+						auto& stream = *reinterpret_cast<ZipEntryStream*>(lua_touserdata(L, 1));
+						if (stream.isDone())
+						{
+							return 0;
+						}
+						const auto n = luaL_optinteger(L, 2, 0x10000);
+						luaL_argcheck(L, n > 0, 2, "must read at least 1 byte");
+						pushString(L, stream.read((size_t)n));
+						return 1;
+					});
+				}},
+				{"chunks", [](lua_State* L) -> int
+				{
+					const auto n = luaL_optinteger(L, 2, 0x10000);
+					luaL_argcheck(L, n > 0, 2, "chunk size must be at least 1");
+					lua_pushinteger(L, n);
+					lua_pushcclosure(L, [](lua_State* L) -> int
+					{
+						return tryCatch(L, [](lua_State* L)
+						{
+							auto& stream = *reinterpret_cast<ZipEntryStream*>(lua_touserdata(L, 1));
+							if (stream.isDone())
+							{
+								return 0;
+							}
+							pushString(L, stream.read((size_t)lua_tointeger(L, lua_upvalueindex(1))));
+							return 1;
+						});
+					}, 1);
+					lua_pushvalue(L, 1);
+					return 2;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::ZipEntryStream",
+				.methods = methods,
+			};
+			return desc;
+		}
+
+		static int lua_ZipReader_open(lua_State* L)
+		{
+			return tryCatch(L, [](lua_State* L)
+			{
+				auto& zr = *reinterpret_cast<IndexedZipReader*>(lua_touserdata(L, 1));
+				const auto data = zr.locateData(checkZipEntryOffset(L, 2));
+				pushNewWithMt<ZipEntryStream>(L, desc_ZipEntryStream(), zr.is, data.offset, data.compressed_size, data.compression_method, data.crc);
+
+				// Keep the ZipReader alive for as long as the stream is.
+				lua_pushvalue(L, 1);
+				lua_setiuservalue(L, -2, 1);
+				return 1;
+			});
+		}
+
+		static int lua_ZipReader_view(lua_State* L)
+		{
+			return tryCatch(L, [](lua_State* L)
+			{
+				auto& zr = *reinterpret_cast<IndexedZipReader*>(lua_touserdata(L, 1));
+				if (!zr.memory)
+				{
+					luaL_error(L, "Zero-copy views require a memory-backed reader, such as soup.MappedFileReader");
+				}
+				const auto data = zr.locateData(checkZipEntryOffset(L, 2));
+				if (data.compression_method != ZipEntryStream::METHOD_STORED)
+				{
+					luaL_error(L, "Zero-copy views are only possible for stored entries, use open instead");
+				}
+				if (data.offset > zr.memory->size || data.compressed_size > zr.memory->size - data.offset)
+				{
+					throw Exception("Entry data is out of bounds");
+				}
+				pushNewWithMt<MemoryRefReader>(L, desc_MemoryRefReader(), zr.memory->data + data.offset, data.compressed_size);
+
+				// Keep the ZipReader, and thereby the memory, alive for as long as the view is.
+				lua_pushvalue(L, 1);
+				lua_setiuservalue(L, -2, 1);
+				return 1;
+			});
+		}
+
+		// Inflates a set of entries on a pool of worker threads. The reader is not thread-safe, so only the thread driving the
+		// extraction reads from it, staying a few entries ahead of the workers. It's therefore free to use the reader in between,
+		// e.g. from an extractMany callback. Owned by a userdata, so the workers are joined even if a Lua error cuts it short.
+		struct ParallelZipExtraction
+		{
+			struct Task
+			{
+				size_t index;
+				IndexedZipReader::EntryData data;
+				std::string compressed;
+			};
+
+			IndexedZipReader& zr;
+			std::vector<const ZipIndexedFile*> entries{};
+			std::filesystem::path out_dir{}; // if set, entries are written to it instead of being kept in results
+
+			std::vector<std::string> results{};
+			std::string error{};
+
+			// Only used by the driving thread.
+			size_t next_read = 0;
+			size_t in_flight = 0;
+			size_t max_in_flight = 0;
+
+			std::mutex mtx{};
+			std::condition_variable work_cv{};
+			std::condition_variable done_cv{};
+			std::deque<Task> queue{};
+			std::vector<size_t> done{};
+			bool stopping = false;
+			std::vector<std::thread> workers{};
+
+			explicit ParallelZipExtraction(IndexedZipReader& zr)
+				: zr(zr)
+			{
+			}
+
+			~ParallelZipExtraction()
+			{
+				stop();
+			}
+
+			void start(unsigned threads)
+			{
+				if (out_dir.empty())
+				{
+					results.resize(entries.size());
+				}
+				threads = (unsigned)std::min<size_t>(threads, entries.size());
+				max_in_flight = (size_t)threads * 2;
+				for (unsigned i = 0; i != threads; ++i)
+				{
+					workers.emplace_back([this]
+					{
+						work();
+					});
+				}
+			}
+
+			// Discards the entries that haven't been inflated yet and joins the workers.
+			void stop()
+			{
+				{
+					std::lock_guard lock(mtx);
+					stopping = true;
+				}
+				work_cv.notify_all();
+				for (auto& t : workers)
+				{
+					t.join();
+				}
+				workers.clear();
+			}
+
+			// Reads ahead for the workers, then blocks until more entries are done and returns their indices. Returns an empty
+			// vector once all entries are done or one of them failed, in which case error is set.
+			[[nodiscard]] std::vector<size_t> waitForCompleted()
+			{
+				for (; next_read != entries.size() && in_flight != max_in_flight; ++next_read, ++in_flight)
+				{
+					Task task{ next_read, zr.locateData(entries[next_read]->offset), {} };
+					task.compressed = IndexedZipReader::readCompressed(zr.is, task.data);
+					{
+						std::lock_guard lock(mtx);
+						queue.emplace_back(std::move(task));
+					}
+					work_cv.notify_one();
+				}
+				std::unique_lock lock(mtx);
+				done_cv.wait(lock, [this]
+				{
+					return !done.empty() || !error.empty() || in_flight == 0;
+				});
+				if (!error.empty())
+				{
+					return {};
+				}
+				in_flight -= done.size();
+				return std::exchange(done, {});
+			}
+
+		private:
+			void work()
+			{
+				while (true)
+				{
+					Task task;
+					{
+						std::unique_lock lock(mtx);
+						work_cv.wait(lock, [this]
+						{
+							return stopping || !queue.empty();
+						});
+						if (stopping)
+						{
+							return;
+						}
+						task = std::move(queue.front());
+						queue.pop_front();
+					}
+					try
+					{
+						const auto& f = *entries[task.index];
+						std::string data = IndexedZipReader::decompress(task.data, std::move(task.compressed), f.uncompressed_size);
+						if (out_dir.empty())
+						{
+							results[task.index] = std::move(data);
+						}
+						else
+						{
+							writeFile(f, data);
+						}
+						std::lock_guard lock(mtx);
+						done.emplace_back(task.index);
+					}
+					catch (std::exception& e)
+					{
+						std::lock_guard lock(mtx);
+						if (error.empty())
+						{
+							error = e.what();
+						}
+					}
+					done_cv.notify_one();
+				}
+			}
+
+		public:
+			void writeFile(const ZipIndexedFile& f, const std::string& data)
+			{
+				const std::filesystem::path name(f.name);
+				if (name.is_absolute() || name.has_root_name() || std::find(name.begin(), name.end(), "..") != name.end())
+				{
+					throw Exception("Refusing to extract entry outside of the target directory: " + f.name);
+				}
+				const auto path = (out_dir / name);
+				std::error_code ec;
+				if (!f.name.empty() && f.name.back() == '/')
+				{
+					std::filesystem::create_directories(path, ec);
+					return;
+				}
+				std::filesystem::create_directories(path.parent_path(), ec);
+				std::ofstream os(path, std::ios::binary);
+				if (!os.write(data.data(), data.size()))
+				{
+					throw Exception("Failed to write " + path.string());
+				}
+			}
+		};
+
+		[[nodiscard]] static unsigned getThreadsOption(lua_State* L, int opts)
+		{
+			unsigned threads = std::thread::hardware_concurrency();
+			if (lua_type(L, opts) == LUA_TTABLE)
+			{
+				if (lua_getfield(L, opts, "threads") != LUA_TNIL)
+				{
+					const auto n = luaL_checkinteger(L, -1);
+					luaL_argcheck(L, n > 0, opts, "threads must be at least 1");
+					threads = (unsigned)n;
+				}
+				lua_pop(L, 1);
+			}
+			return std::max(threads, 1u);
+		}
+
+		// Accepts an array of entries from getFileList/find/entries, entry names, or entry offsets. The vector should be owned by
+		// a userdata, as this may raise a Lua error.
+		static void checkZipEntries(lua_State* L, int i, IndexedZipReader& zr, std::vector<const ZipIndexedFile*>& entries)
+		{
+			luaL_checktype(L, i, LUA_TTABLE);
+			entries.reserve(lua_rawlen(L, i));
+			for (lua_Integer k = 1; lua_rawgeti(L, i, k) != LUA_TNIL; ++k)
+			{
+				const int e = lua_gettop(L);
+				const ZipIndexedFile* f = nullptr;
+				if (lua_type(L, e) == LUA_TSTRING)
+				{
+					f = zr.find(lua_tostring(L, e));
+				}
+				else if (lua_type(L, e) == LUA_TTABLE && lua_getfield(L, e, "name") == LUA_TSTRING)
+				{
+					f = zr.find(lua_tostring(L, -1));
+				}
+				else
+				{
+					f = zr.findByOffset(checkZipEntryOffset(L, e));
+				}
+				if (f == nullptr)
+				{
+					luaL_error(L, "entry #%d is not in this archive", (int)k);
+				}
+				entries.emplace_back(f);
+				lua_settop(L, e - 1);
+			}
+			lua_pop(L, 1);
+		}
+
+		static const TypeDesc& desc_ParallelZipExtraction()
+		{
+			static constexpr TypeDesc desc{
+				.name = "soup::ParallelZipExtraction",
+			};
+			return desc;
+		}
+
+		// The job keeps the ZipReader at index 1 alive, as the workers use its entries.
+		[[nodiscard]] static ParallelZipExtraction& pushZipExtraction(lua_State* L, IndexedZipReader& zr)
+		{
+			auto job = pushNewWithMt<ParallelZipExtraction>(L, desc_ParallelZipExtraction(), zr);
+			lua_pushvalue(L, 1);
+			lua_setiuservalue(L, -2, 1);
+			return *job;
+		}
+
+		static int lua_ZipReader_extractMany(lua_State* L)
+		{
+			return tryCatch(L, [](lua_State* L)
+			{
+				auto& zr = *reinterpret_cast<IndexedZipReader*>(lua_touserdata(L, 1));
+				lua_settop(L, 3);
+				const unsigned threads = getThreadsOption(L, 3);
+				bool as_buffer = false;
+				if (lua_type(L, 3) == LUA_TTABLE)
+				{
+					lua_getfield(L, 3, "buffer");
+					as_buffer = lua_toboolean(L, -1);
+					lua_pop(L, 1);
+				}
+				if (lua_type(L, 3) != LUA_TTABLE || lua_getfield(L, 3, "callback") == LUA_TNIL)
+				{
+					lua_settop(L, 4);
+				}
+				const bool has_callback = !lua_isnil(L, 4);
+				if (has_callback)
+				{
+					luaL_checktype(L, 4, LUA_TFUNCTION);
+				}
+
+				auto& job = pushZipExtraction(L, zr);
+				checkZipEntries(L, 2, zr, job.entries);
+				if (!has_callback)
+				{
+					lua_createtable(L, (int)job.entries.size(), 0);
+				}
+				job.start(threads);
+				bool callback_failed = false;
+				for (std::vector<size_t> batch; !callback_failed && !(batch = job.waitForCompleted()).empty(); )
+				{
+					for (const auto i : batch)
+					{
+						if (has_callback)
+						{
+							lua_pushvalue(L, 4);
+							pushZipEntry(L, *job.entries[i]);
+							pushContents(L, std::move(job.results[i]), as_buffer);
+							if (lua_pcall(L, 2, 0, 0) != LUA_OK)
+							{
+								callback_failed = true;
+								break;
+							}
+						}
+						else
+						{
+							pushContents(L, std::move(job.results[i]), as_buffer);
+							lua_rawseti(L, 6, i + 1);
+						}
+					}
+				}
+				job.stop();
+				if (callback_failed)
+				{
+					lua_error(L);
+				}
+				if (!job.error.empty())
+				{
+					throw Exception(job.error);
+				}
+				return has_callback ? 0 : 1;
+			});
+		}
+
+		static int lua_ZipReader_extractAllTo(lua_State* L)
+		{
+			return tryCatch(L, [](lua_State* L)
+			{
+				auto& zr = *reinterpret_cast<IndexedZipReader*>(lua_touserdata(L, 1));
+				luaL_checkstring(L, 2);
+				const unsigned threads = getThreadsOption(L, 3);
+
+				auto& job = pushZipExtraction(L, zr);
+				job.out_dir = lua_tostring(L, 2);
+
+				// Entries that would be written to the same file, i.e. duplicate names or ones that only differ in case, which is
+				// the same file on case-insensitive file systems, mustn't be written concurrently. They're extracted one after
+				// another in archive order once the others are done, so the last one wins, as it would when extracting sequentially.
+				const auto target_key = [](const std::string& name)
+				{
+					auto key = std::filesystem::path(name).lexically_normal().generic_string();
+					if (!key.empty() && key.back() == '/')
+					{
+						key.pop_back();
+					}
+					std::transform(key.begin(), key.end(), key.begin(), [](char c)
+					{
+						return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+					});
+					return key;
+				};
+				std::unordered_map<std::string, size_t> targets{};
+				for (const auto& f : zr.getIndexedFiles())
+				{
+					++targets[target_key(f.name)];
+				}
+				std::vector<const ZipIndexedFile*> colliding{};
+				for (const auto& f : zr.getIndexedFiles())
+				{
+					(targets.at(target_key(f.name)) == 1 ? job.entries : colliding).emplace_back(&f);
+				}
+
+				size_t extracted = 0;
+				if (!job.entries.empty())
+				{
+					job.start(threads);
+					for (std::vector<size_t> batch; !(batch = job.waitForCompleted()).empty(); )
+					{
+						extracted += batch.size();
+					}
+					job.stop();
+					if (!job.error.empty())
+					{
+						throw Exception(job.error);
+					}
+				}
+				for (const auto f : colliding)
+				{
+					const auto data = zr.locateData(f->offset);
+					job.writeFile(*f, IndexedZipReader::decompress(data, IndexedZipReader::readCompressed(zr.is, data), f->uncompressed_size));
+					++extracted;
+				}
+				lua_pushinteger(L, extracted);
+				return 1;
+			});
+		}
+
+		// A read that runs on the IoPool. The result and error are written before the state changes to DONE, so they can be read
+		// without locking once it has. The work owns everything it reads from, so the job can outlive the state that started it.
+		struct IoJob
+		{
+			enum State : uint8_t
+			{
+				QUEUED,
+				RUNNING,
+				DONE,
+			};
+
+			std::function<std::string()> work;
+			std::weak_ptr<IoCompletionQueue> completions; // not shared, as the queue holds on to the jobs it has been handed
+
+			std::mutex mtx{};
+			std::condition_variable cv{};
+			State state = QUEUED;
+			bool cancelled = false;
+			std::string result{};
+			std::string error{};
+
+			IoJob(std::function<std::string()>&& work, const std::shared_ptr<IoCompletionQueue>& completions)
+				: work(std::move(work)), completions(completions)
+			{
+			}
+
+			[[nodiscard]] bool isDone()
+			{
+				std::lock_guard lock(mtx);
+				return state == DONE;
+			}
+
+			void wait()
+			{
+				std::unique_lock lock(mtx);
+				cv.wait(lock, [this]
+				{
+					return state == DONE;
+				});
+			}
+
+			// For when nobody is interested in the result anymore. Doesn't wait for a worker that is running the job; it just
+			// won't hand the result to the completion queue.
+			void cancel()
+			{
+				std::lock_guard lock(mtx);
+				cancelled = true;
+			}
+
+			static void run(SharedPtr<IoJob>&& job)
+			{
+				{
+					std::lock_guard lock(job->mtx);
+					if (job->cancelled)
+					{
+						job->state = DONE;
+						return;
+					}
+					job->state = RUNNING;
+				}
+				std::string result, error;
+				try
+				{
+					result = job->work();
+				}
+				catch (std::exception& e)
+				{
+					error = e.what();
+				}
+				bool cancelled;
+				{
+					std::lock_guard lock(job->mtx);
+					job->result = std::move(result);
+					job->error = std::move(error);
+					job->state = DONE;
+					cancelled = job->cancelled;
+				}
+				job->cv.notify_all();
+				if (!cancelled)
+				{
+					if (auto completions = job->completions.lock())
+					{
+						completions->push(std::move(job));
+					}
+				}
+			}
+		};
+
+		// Worker threads for IoJobs, shared by all states. Started on first use.
+		struct IoPool
+		{
+			std::mutex mtx{};
+			std::condition_variable cv{};
+			std::deque<SharedPtr<IoJob>> queue{};
+			bool stopping = false;
+			std::vector<std::thread> workers{};
+
+			explicit IoPool(unsigned threads)
+			{
+				for (unsigned i = 0; i != threads; ++i)
+				{
+					workers.emplace_back([this]
+					{
+						work();
+					});
+				}
+			}
+
+			~IoPool()
+			{
+				{
+					std::lock_guard lock(mtx);
+					stopping = true;
+				}
+				cv.notify_all();
+				for (auto& t : workers)
+				{
+					t.join();
+				}
+			}
+
+			void submit(SharedPtr<IoJob> job)
+			{
+				{
+					std::lock_guard lock(mtx);
+					queue.emplace_back(std::move(job));
+				}
+				cv.notify_one();
+			}
+
+		private:
+			void work()
+			{
+				while (true)
+				{
+					SharedPtr<IoJob> job;
+					{
+						std::unique_lock lock(mtx);
+						cv.wait(lock, [this]
+						{
+							return stopping || !queue.empty();
+						});
+						if (queue.empty())
+						{
+							return;
+						}
+						job = std::move(queue.front());
+						queue.pop_front();
+					}
+					IoJob::run(std::move(job));
+				}
+			}
+		};
+
+		[[nodiscard]] static IoPool& io_pool()
+		{
+			static IoPool inst(std::clamp(std::thread::hardware_concurrency(), 2u, 8u));
+			return inst;
+		}
+
+		static constexpr unsigned MAX_DNS_LOOKUPS = 16;
+
+		// Reverse DNS lookups mostly wait on the network, and one that has started can't be interrupted, so they get workers of
+		// their own. That way, slow lookups, including ones whose results nobody wants anymore, never hold up file reads.
+		[[nodiscard]] static IoPool& dns_pool()
+		{
+			static IoPool inst(MAX_DNS_LOOKUPS);
+			return inst;
+		}
+
+		// Owned by the IoTask userdata. Collecting it never blocks, since the job doesn't depend on anything the state owns.
+		struct IoTask
+		{
+			SharedPtr<IoJob> job;
+
+			explicit IoTask(SharedPtr<IoJob> job)
+				: job(std::move(job))
+			{
+			}
+
+			~IoTask()
+			{
+				job->cancel();
+			}
+		};
+
+		static const TypeDesc& desc_IoTask()
+		{
+			static constexpr luaL_Reg methods[] = {
+				{"isDone", [](lua_State* L) -> int
+				{
+					lua_pushboolean(L, reinterpret_cast<IoTask*>(lua_touserdata(L, 1))->job->isDone());
+					return 1;
+				}},
+				{"await", &lua_IoTask_await},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::IoTask",
+				.methods = methods,
+			};
+			return desc;
+		}
+
+		// Submits the work to the IoPool and pushes an IoTask for it. The work must not refer to anything owned by the state.
+		static void pushIoTask(lua_State* L, std::function<std::string()>&& work)
+		{
+			auto job = soup::make_shared<IoJob>(std::move(work), getContext(L).io_completions);
+			pushNewWithMt<IoTask>(L, desc_IoTask(), job);
+			io_pool().submit(std::move(job));
+		}
+
+		static inline const char io_waiters_key{};
+
+		// Maps jobs to the coroutines that are suspended in IoTask:await for them, so soup.pumpIo can resume them.
+		static void pushIoWaiters(lua_State* L)
+		{
+			if (lua_rawgetp(L, LUA_REGISTRYINDEX, &io_waiters_key) != LUA_TTABLE)
+			{
+				lua_pop(L, 1);
+				lua_newtable(L);
+				lua_pushvalue(L, -1);
+				lua_rawsetp(L, LUA_REGISTRYINDEX, &io_waiters_key);
+			}
+		}
+
+		// Returns true if the caller should yield, in which case the coroutine is registered to be resumed by soup.pumpIo once
+		// the job is done; resuming it any other way is fine, too. Otherwise, the job is done by the time this returns, since
+		// outside of a coroutine this blocks.
+		[[nodiscard]] static bool awaitIoJob(lua_State* L, IoJob& job)
+		{
+			pushIoWaiters(L);
+			if (!job.isDone() && lua_isyieldable(L))
+			{
+				lua_pushthread(L);
+				lua_rawsetp(L, -2, &job);
+				lua_pop(L, 1);
+				return true;
+			}
+			lua_pushnil(L);
+			lua_rawsetp(L, -2, &job);
+			lua_pop(L, 1);
+			job.wait();
+			return false;
+		}
+
+		static int lua_IoTask_await(lua_State* L)
+		{
+			checkType(L, 1, desc_IoTask());
+			auto& job = *reinterpret_cast<IoTask*>(lua_touserdata(L, 1))->job;
+			if (awaitIoJob(L, job))
+			{
+				return lua_yieldk(L, 0, 0, [](lua_State* L, int, lua_KContext) -> int
+				{
+					lua_settop(L, 1);
+					return lua_IoTask_await(L);
+				});
+			}
+			if (!job.error.empty())
+			{
+				luaL_error(L, "%s", job.error.c_str());
+			}
+			pushString(L, job.result);
+			return 1;
+		}
+
+		// Pushes the coroutine waiting for the next finished job, if there is one. Returns LUA_TNONE once no jobs are left.
+		[[nodiscard]] static int pushNextIoWaiter(lua_State* L, IoCompletionQueue& completions)
+		{
+			const auto job = completions.pop();
+			if (!job)
+			{
+				return LUA_TNONE;
+			}
+			pushIoWaiters(L);
+			const auto type = lua_rawgetp(L, -1, job.get());
+			lua_pushnil(L);
+			lua_rawsetp(L, -3, job.get());
+			lua_remove(L, -2);
+			return type;
+		}
+
+		// Resumes the coroutines whose IoTask:await can now return and returns how many there were. If one of them raises an
+		// error, it is propagated; the rest are resumed by the next call.
+		static int lua_pumpIo(lua_State* L)
+		{
+			auto& completions = *getContext(L).io_completions;
+			lua_Integer resumed = 0;
+			for (int type; (type = pushNextIoWaiter(L, completions)) != LUA_TNONE; )
+			{
+				lua_State* co = (type == LUA_TTHREAD ? lua_tothread(L, -1) : nullptr);
+				if (co && lua_status(co) == LUA_YIELD)
+				{
+					int nres;
+					const auto status = lua_resume(co, L, 0, &nres);
+					if (status != LUA_OK && status != LUA_YIELD)
+					{
+						lua_xmove(co, L, 1);
+						lua_error(L);
+					}
+					lua_pop(co, nres);
+					++resumed;
+				}
+				lua_pop(L, 1);
+			}
+			lua_pushinteger(L, resumed);
+			return 1;
+		}
+
+		// Blocks until an async read has finished, so an event loop with nothing else to do can wait for soup.pumpIo to have
+		// work. Returns false if the timeout expired first.
+		static int lua_waitIo(lua_State* L)
+		{
+			std::optional<std::chrono::milliseconds> timeout{};
+			if (!lua_isnoneornil(L, 1))
+			{
+				timeout = std::chrono::milliseconds(luaL_checkinteger(L, 1));
+			}
+			lua_pushboolean(L, getContext(L).io_completions->waitFor(timeout));
+			return 1;
+		}
+
+		static int lua_readFileAsync(lua_State* L)
+		{
+			std::string path = luaL_checkstring(L, 1);
+			pushIoTask(L, [path{ std::move(path) }]
+			{
+				return readWholeFile(path);
+			});
+			return 1;
+		}
+
+		// The worker doesn't share the ZipReader's reader. FileReader-backed archives are opened again. For other readers,
+		// including memory-backed ones, whose memory belongs to the state, the compressed data is copied and only the inflating
+		// happens in the background.
+		static int lua_ZipReader_getFileContentsAsync(lua_State* L)
+		{
+			return tryCatch(L, [](lua_State* L)
+			{
+				auto& zr = *reinterpret_cast<IndexedZipReader*>(lua_touserdata(L, 1));
+				const auto offset = checkZipEntryOffset(L, 2);
+				const auto f = zr.findByOffset(offset);
+				const size_t uncompressed_size = (f ? f->uncompressed_size : 0);
+				const auto read = [=, cd{ f ? std::optional<ZipIndexedFile>(*f) : std::nullopt }](Reader& is)
+				{
+					auto data = IndexedZipReader::locateData(is, offset);
+					if (cd)
+					{
+						data.compressed_size = cd->compressed_size;
+						data.crc = cd->uncompressed_data_crc32;
+					}
+					else if (data.sizes_in_descriptor)
+					{
+						data.compressed_size = 0;
+					}
+					return IndexedZipReader::decompress(data, IndexedZipReader::readCompressed(is, data), uncompressed_size);
+				};
+
+				lua_getiuservalue(L, 1, 1);
+				if (isType(L, -1, desc_FileReader()) && lua_getiuservalue(L, -1, 1) == LUA_TSTRING)
+				{
+					pushIoTask(L, [read, path{ std::string(lua_tostring(L, -1)) }]
+					{
+						FileReader is(path);
+						return read(is);
+					});
+					return 1;
+				}
+
+				const auto data = zr.locateData(offset);
+				pushIoTask(L, [data, compressed{ IndexedZipReader::readCompressed(zr.is, data) }, uncompressed_size]() mutable
+				{
+					return IndexedZipReader::decompress(data, std::move(compressed), uncompressed_size);
+				});
+				return 1;
+			});
+		}
+
+		[[nodiscard]] static std::string readWholeFile(const std::string& path)
+		{
+			// A directory opens fine, but seeking to its end reports a bogus size rather than failing.
+			std::error_code ec;
+			if (std::filesystem::is_directory(path, ec))
+			{
+				throw Exception(path + " is a directory");
+			}
+			std::ifstream is(path, std::ios::binary);
+			if (!is)
+			{
+				throw Exception("Failed to open " + path);
+			}
+			is.seekg(0, std::ios::end);
+			const auto size = is.tellg();
+			if (!is || size < 0)
+			{
+				throw Exception("Failed to determine the size of " + path);
+			}
+			std::string data{};
+			data.resize((size_t)size);
+			is.seekg(0);
+			if (!is.read(data.data(), data.size()))
+			{
+				throw Exception("Failed to read " + path);
+			}
+			return data;
+		}
+
+		// Compresses entries on its own worker threads while the thread that adds them writes each one out as soon as it and
+		// all entries before it are done, so the archive comes out in the order the entries were added.
+		struct ZipWriter
+		{
+			struct Entry
+			{
+				std::string name;
+				int level;
+				std::string path{};
+				SharedPtr<BufferStorage> storage{};
+				BufferPin pin{}; // if the storage is a Lua buffer, until the entry is written or the worker is known to be done with it
+				size_t offset = 0;
+				size_t size = 0;
+
+				// Written by the worker before done is set.
+				uint16_t method = ZipEntryStream::METHOD_STORED;
+				uint32_t crc = 0;
+				std::string compressed{};
+				std::string error{};
+				bool done = false;
+
+				Entry(std::string&& name, int level)
+					: name(std::move(name)), level(level)
+				{
+				}
+			};
+
+			struct CentralRecord
+			{
+				std::string name;
+				uint16_t method;
+				uint32_t crc;
+				uint32_t compressed_size;
+				uint32_t uncompressed_size;
+				uint32_t offset;
+			};
+
+			std::ofstream file{};
+			std::string memory{};
+			bool to_memory;
+			size_t written = 0;
+			bool finished = false;
+			std::string failure{}; // set once writing failed, after which the archive is incomplete and the writer unusable
+			size_t max_pending;
+
+			std::deque<std::unique_ptr<Entry>> pending{};
+			std::vector<CentralRecord> records{};
+
+			std::mutex mtx{};
+			std::condition_variable work_cv{};
+			std::condition_variable done_cv{};
+			std::deque<Entry*> queue{};
+			bool stopping = false;
+			std::vector<std::thread> workers{};
+
+			explicit ZipWriter(unsigned threads)
+				: to_memory(true)
+			{
+				start(threads);
+			}
+
+			ZipWriter(unsigned threads, const std::filesystem::path& path)
+				: file(path, std::ios::binary), to_memory(false)
+			{
+				if (!file)
+				{
+					throw Exception("Failed to open " + path.string());
+				}
+				start(threads);
+			}
+
+			~ZipWriter()
+			{
+				{
+					std::lock_guard lock(mtx);
+					stopping = true;
+				}
+				work_cv.notify_all();
+				for (auto& t : workers)
+				{
+					t.join();
+				}
+			}
+
+			void add(std::unique_ptr<Entry>&& e)
+			{
+				checkUsable();
+				if (e->name.size() > 0xFFFF)
+				{
+					throw Exception("Entry name is longer than 65535 bytes");
+				}
+				if (records.size() + pending.size() >= 0xFFFF)
+				{
+					throw Exception("Too many entries; ZIP64 is not supported");
+				}
+				{
+					std::lock_guard lock(mtx);
+					queue.emplace_back(e.get());
+				}
+				pending.emplace_back(std::move(e));
+				work_cv.notify_one();
+				writeCompleted(max_pending);
+			}
+
+			void finish()
+			{
+				checkUsable();
+				writeCompleted(0);
+				finished = true;
+
+				const size_t cd_offset = written;
+				for (const auto& r : records)
+				{
+					std::string header;
+					put32(header, 0x02014b50);
+					put16(header, 20); // made by
+					put16(header, r.method == ZipEntryStream::METHOD_DEFLATE ? 20 : 10);
+					put16(header, 0x0800); // UTF-8 names
+					put16(header, r.method);
+					put16(header, 0); // time
+					put16(header, 0x21); // date: 1980-01-01
+					put32(header, r.crc);
+					put32(header, r.compressed_size);
+					put32(header, r.uncompressed_size);
+					put16(header, (uint16_t)r.name.size());
+					put16(header, 0); // extra field length
+					put16(header, 0); // comment length
+					put16(header, 0); // disk number
+					put16(header, 0); // internal attributes
+					put32(header, 0); // external attributes
+					put32(header, r.offset);
+					header.append(r.name);
+					write(header.data(), header.size());
+				}
+				const size_t cd_size = written - cd_offset;
+				if (written > 0xFFFFFFFF)
+				{
+					fail("Archive is too large; ZIP64 is not supported");
+				}
+
+				std::string eocd;
+				put32(eocd, 0x06054b50);
+				put16(eocd, 0); // disk number
+				put16(eocd, 0); // disk with central directory
+				put16(eocd, (uint16_t)records.size());
+				put16(eocd, (uint16_t)records.size());
+				put32(eocd, (uint32_t)cd_size);
+				put32(eocd, (uint32_t)cd_offset);
+				put16(eocd, 0); // comment length
+				write(eocd.data(), eocd.size());
+
+				if (!to_memory)
+				{
+					file.close();
+					if (!file)
+					{
+						throw Exception("Failed to write archive");
+					}
+				}
+			}
+
+		private:
+			void checkUsable() const
+			{
+				if (finished)
+				{
+					throw Exception("ZipWriter has already been finished");
+				}
+				if (!failure.empty())
+				{
+					throw Exception("ZipWriter can't be used after it failed: " + failure);
+				}
+			}
+
+			// Entries after the one that failed can't be written either, as the archive would be missing it, so give up on all
+			// of them. Workers still compressing one of them finish on their own; the entries are kept alive until they're joined,
+			// but the buffers of all others can be modified again.
+			[[noreturn]] void fail(std::string msg)
+			{
+				failure = msg;
+				{
+					std::lock_guard lock(mtx);
+					for (const auto& e : queue)
+					{
+						e->pin.release();
+					}
+					queue.clear();
+					for (const auto& e : pending)
+					{
+						if (e->done)
+						{
+							e->pin.release();
+						}
+					}
+				}
+				if (!to_memory)
+				{
+					file.close();
+				}
+				throw Exception(std::move(msg));
+			}
+
+			void start(unsigned threads)
+			{
+				max_pending = (size_t)threads * 4;
+				for (unsigned i = 0; i != threads; ++i)
+				{
+					workers.emplace_back([this]
+					{
+						work();
+					});
+				}
+			}
+
+			void work()
+			{
+				while (true)
+				{
+					Entry* e;
+					{
+						std::unique_lock lock(mtx);
+						work_cv.wait(lock, [this]
+						{
+							return stopping || !queue.empty();
+						});
+						if (stopping)
+						{
+							return;
+						}
+						e = queue.front();
+						queue.pop_front();
+					}
+					try
+					{
+						compress(*e);
+					}
+					catch (std::exception& ex)
+					{
+						e->error = ex.what();
+					}
+					{
+						std::lock_guard lock(mtx);
+						e->done = true;
+					}
+					done_cv.notify_one();
+				}
+			}
+
+			static void compress(Entry& e)
+			{
+				if (!e.path.empty())
+				{
+					auto data = readWholeFile(e.path);
+					e.size = data.size();
+					e.storage = soup::make_shared<BufferStorage>(std::move(data));
+				}
+				if (e.size >= 0xFFFFFFFF)
+				{
+					throw Exception("Entry is too large; ZIP64 is not supported: " + e.name);
+				}
+				const auto data = reinterpret_cast<const uint8_t*>(e.storage->bytes.data()) + e.offset;
+				e.crc = crc32::hash(data, e.size);
+				if (e.level != 0 && e.size != 0)
+				{
+					auto compressed = LuaDeflateCompressor::compress(data, e.size, e.level);
+					if (compressed.size() < e.size)
+					{
+						e.method = ZipEntryStream::METHOD_DEFLATE;
+						e.compressed = std::move(compressed);
+					}
+				}
+			}
+
+			// Writes out finished entries in order until no more than `limit` are left, waiting for them as needed.
+			void writeCompleted(size_t limit)
+			{
+				while (!pending.empty())
+				{
+					auto& e = *pending.front();
+					{
+						std::unique_lock lock(mtx);
+						if (!e.done)
+						{
+							if (pending.size() <= limit)
+							{
+								return;
+							}
+							done_cv.wait(lock, [&e]
+							{
+								return e.done;
+							});
+						}
+					}
+					if (!e.error.empty())
+					{
+						fail("Failed to add " + e.name + ": " + e.error);
+					}
+					writeEntry(e);
+					pending.pop_front();
+				}
+			}
+
+			void writeEntry(const Entry& e)
+			{
+				if (written > 0xFFFFFFFF)
+				{
+					fail("Archive is too large; ZIP64 is not supported");
+				}
+				const bool deflated = (e.method == ZipEntryStream::METHOD_DEFLATE);
+				const char* data = (deflated ? e.compressed.data() : e.storage->bytes.data() + e.offset);
+				const size_t size = (deflated ? e.compressed.size() : e.size);
+
+				records.emplace_back(CentralRecord{ e.name, e.method, e.crc, (uint32_t)size, (uint32_t)e.size, (uint32_t)written });
+				std::string header;
+				put32(header, 0x04034b50);
+				put16(header, deflated ? 20 : 10);
+				put16(header, 0x0800); // UTF-8 names
+				put16(header, e.method);
+				put16(header, 0); // time
+				put16(header, 0x21); // date: 1980-01-01
+				put32(header, e.crc);
+				put32(header, (uint32_t)size);
+				put32(header, (uint32_t)e.size);
+				put16(header, (uint16_t)e.name.size());
+				put16(header, 0); // extra field length
+				header.append(e.name);
+				write(header.data(), header.size());
+				write(data, size);
+			}
+
+			void write(const char* data, size_t size)
+			{
+				if (to_memory)
+				{
+					memory.append(data, size);
+				}
+				else
+				{
+					file.write(data, size);
+				}
+				written += size;
+			}
+
+			static void put16(std::string& out, uint16_t v)
+			{
+				out.push_back((char)(v & 0xFF));
+				out.push_back((char)(v >> 8));
+			}
+
+			static void put32(std::string& out, uint32_t v)
+			{
+				put16(out, (uint16_t)(v & 0xFFFF));
+				put16(out, (uint16_t)(v >> 16));
+			}
+		};
+
+		[[nodiscard]] static int checkZipLevel(lua_State* L, int i)
+		{
+			const auto level = luaL_optinteger(L, i, 6);
+			luaL_argcheck(L, level >= 0 && level <= 9, i, "level must be between 0 and 9");
+			return (int)level;
+		}
+
+		static const TypeDesc& desc_ZipWriter()
+		{
+			static constexpr luaL_Reg methods[] = {
+				{"add", [](lua_State* L) -> int
+				{
+					return tryCatch(L, [](lua_State* L)
+					{
+						auto& zw = *reinterpret_cast<ZipWriter*>(lua_touserdata(L, 1));
+						auto e = std::make_unique<ZipWriter::Entry>(luaL_checkstring(L, 2), checkZipLevel(L, 4));
+						if (isType(L, 3, desc_Buffer()))
+						{
+							const auto& buf = *reinterpret_cast<BufferView*>(lua_touserdata(L, 3));
+							e->storage = buf.storage;
+							e->pin = BufferPin(buf.storage);
+							e->offset = buf.offset;
+							e->size = buf.size;
+						}
+						else
+						{
+							size_t size;
+							const char* data = luaL_checklstring(L, 3, &size);
+							e->storage = soup::make_shared<BufferStorage>(std::string(data, size));
+							e->size = size;
+						}
+						zw.add(std::move(e));
+						return 0;
+					});
+				}},
+				{"addFile", [](lua_State* L) -> int
+				{
+					return tryCatch(L, [](lua_State* L)
+					{
+						auto& zw = *reinterpret_cast<ZipWriter*>(lua_touserdata(L, 1));
+						auto e = std::make_unique<ZipWriter::Entry>(luaL_checkstring(L, 2), checkZipLevel(L, 4));
+						e->path = luaL_checkstring(L, 3);
+						zw.add(std::move(e));
+						return 0;
+					});
+				}},
+				{"finish", [](lua_State* L) -> int
+				{
+					return tryCatch(L, [](lua_State* L)
+					{
+						auto& zw = *reinterpret_cast<ZipWriter*>(lua_touserdata(L, 1));
+						zw.finish();
+						if (!zw.to_memory)
+						{
+							return 0;
+						}
+						pushBuffer(L, std::move(zw.memory));
+						return 1;
+					});
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::ZipWriter",
+				.methods = methods,
+			};
+			return desc;
+		}
+
+		static int lua_ZipWriter(lua_State* L)
+		{
+			return tryCatch(L, [](lua_State* L)
 			{
-				lua_pushstring(L, "__tostring");
-				lua_pushcfunction(L, [](lua_State* L) -> int
+				const unsigned threads = getThreadsOption(L, 2);
+				if (lua_isnoneornil(L, 1))
 				{
-					pushString(L, reinterpret_cast<IpAddr*>(lua_touserdata(L, 1))->toString());
-					return 1;
-				});
-				lua_settable(L, -3);
-			}
-			lua_setmetatable(L, -2);
-			return 1;
+					pushNewWithMt<ZipWriter>(L, desc_ZipWriter(), threads);
+				}
+				else
+				{
+					pushNewWithMt<ZipWriter>(L, desc_ZipWriter(), threads, std::filesystem::path(luaL_checkstring(L, 1)));
+				}
+				return 1;
+			});
 		}
-#pragma endregion Lua API - Net
+#pragma endregion Lua API - I/O
 
-#pragma region Lua API - Math
-		static void open_setMathFields(lua_State* L)
+#pragma region Stats
+		// Counters for one binding. Shared by all states, so they are atomic.
+		struct BindingStats
 		{
-			lua_pushcfunction(L, &lua_Matrix);
-			lua_setfield(L, -2, "Matrix");
+			static constexpr size_t NUM_BUCKETS = 32; // bucket i counts calls that took less than 2^(i + 1) ns
 
-			lua_pushcfunction(L, &lua_Vector3);
-			lua_setfield(L, -2, "Vector3");
-		}
+			std::atomic_uint64_t calls{0};
+			std::atomic_uint64_t total_ns{0};
+			std::atomic_uint64_t bytes_returned{0};
+			std::atomic_uint64_t exceptions{0};
+			std::array<std::atomic_uint64_t, NUM_BUCKETS> histogram{};
 
-		static int lua_Matrix(lua_State* L)
-		{
-			pushNewAndBeginMt(Matrix);
+			void record(uint64_t ns, uint64_t bytes) noexcept
 			{
-				lua_pushstring(L, "__index");
-				lua_pushcfunction(L, [](lua_State* L) -> int
-				{
-					switch (joaat::hash(luaL_checkstring(L, 2)))
-					{
-					case joaat::hash("setPosRotXYZ"):
-						lua_pushcfunction(L, &lua_Matrix_setPosRotXYZ);
-						return 1;
-					}
-					return 0;
-				});
-				lua_settable(L, -3);
+				calls.fetch_add(1, std::memory_order_relaxed);
+				total_ns.fetch_add(ns, std::memory_order_relaxed);
+				bytes_returned.fetch_add(bytes, std::memory_order_relaxed);
+				histogram[std::clamp<size_t>(std::bit_width(ns), 1, NUM_BUCKETS) - 1].fetch_add(1, std::memory_order_relaxed);
 			}
+
+			void reset() noexcept
 			{
-				lua_pushstring(L, "__mul");
-				lua_pushcfunction(L, [](lua_State* L) -> int
+				calls = 0;
+				total_ns = 0;
+				bytes_returned = 0;
+				exceptions = 0;
+				for (auto& bucket : histogram)
 				{
-					checkTypename(L, 2, "soup::Vector3");
-					Matrix& m = *reinterpret_cast<Matrix*>(lua_touserdata(L, 1));
-					*pushNewVector3(L) = (m * *reinterpret_cast<Vector3*>(lua_touserdata(L, 2)));
-					return 1;
-				});
-				lua_settable(L, -3);
+					bucket = 0;
+				}
 			}
-			lua_setmetatable(L, -2);
-			return 1;
+		};
+
+		struct BindingStatsRegistry
+		{
+			std::mutex mtx{};
+			std::unordered_map<std::string, BindingStats> stats{}; // node-based, so pointers to the values stay valid
+		};
+
+		[[nodiscard]] static BindingStatsRegistry& getBindingStatsRegistry()
+		{
+			static BindingStatsRegistry inst;
+			return inst;
 		}
 
-		static int lua_Matrix_setPosRotXYZ(lua_State* L)
+#if SOUP_LUA_BINDINGS_STATS
+		// Set by tryCatch right before it raises the error, so the trampoline that catches it can tell exceptions apart from
+		// other errors.
+		static inline thread_local bool binding_raised_exception = false;
+
+		// Replaces the C function on top of the stack with a closure that records its stats under the given name.
+		static void instrumentFunction(lua_State* L, const std::string& name)
 		{
-			Vector3 pos, rot;
-			if (lua_gettop(L) == 3)
-			{
-				checkTypename(L, 2, "soup::Vector3"); pos = *reinterpret_cast<Vector3*>(lua_touserdata(L, 2));
-				checkTypename(L, 3, "soup::Vector3"); rot = *reinterpret_cast<Vector3*>(lua_touserdata(L, 3));
-			}
-			else
+			auto& registry = getBindingStatsRegistry();
+			BindingStats* stats;
 			{
-				pos.x = (float)luaL_checknumber(L, 2);
-				pos.y = (float)luaL_checknumber(L, 3);
-				pos.z = (float)luaL_checknumber(L, 4);
-				rot.x = (float)luaL_checknumber(L, 5);
-				rot.y = (float)luaL_checknumber(L, 6);
-				rot.z = (float)luaL_checknumber(L, 7);
+				std::lock_guard lock(registry.mtx);
+				stats = &registry.stats[name];
 			}
-			reinterpret_cast<Matrix*>(lua_touserdata(L, 1))->setPosRotXYZ(pos, rot);
-			return 0;
+			lua_pushlightuserdata(L, stats);
+			lua_insert(L, -2);
+			lua_pushcclosure(L, &lua_statsTrampoline, 2);
 		}
 
-		static int lua_Vector3(lua_State* L)
+		// Instruments the C functions in the table on top of the stack and in the tables nested in it.
+		static void instrumentTable(lua_State* L, const std::string& prefix)
 		{
-			const auto args = lua_gettop(L);
-			auto v = pushNewVector3(L);
-			if (args >= 3)
+			lua_pushnil(L);
+			while (lua_next(L, -2))
 			{
-				v->x = (float)luaL_checknumber(L, 1);
-				v->y = (float)luaL_checknumber(L, 2);
-				v->z = (float)luaL_checknumber(L, 3);
+				if (lua_type(L, -2) == LUA_TSTRING)
+				{
+					const auto name = prefix + '.' + lua_tostring(L, -2);
+					if (lua_type(L, -1) == LUA_TTABLE)
+					{
+						instrumentTable(L, name);
+					}
+					else if (lua_tocfunction(L, -1))
+					{
+						if (lua_getupvalue(L, -1, 1)) // closures can't be wrapped without breaking their upvalue indices
+						{
+							lua_pop(L, 2);
+							continue;
+						}
+						instrumentFunction(L, name);
+						lua_pushvalue(L, -2);
+						lua_insert(L, -2);
+						lua_rawset(L, -4); // assigning to an existing field is fine during traversal
+						continue;
+					}
+				}
+				lua_pop(L, 1);
 			}
-			return 1;
 		}
-#pragma endregion Lua API - Math
 
-#pragma region Lua API - I/O
-		static void open_setIoFields(lua_State* L)
+		// upvalue 1 = BindingStats, upvalue 2 = binding
+		// The binding is called through lua_pcallk, so calls are recorded even if they raise an error or yield. Calls that yield
+		// are timed until they return, including the time their coroutine was suspended.
+		static int lua_statsTrampoline(lua_State* L)
 		{
-			lua_pushcfunction(L, &lua_FileReader);
-			lua_setfield(L, -2, "FileReader");
-
-			lua_pushcfunction(L, &lua_StringReader);
-			lua_setfield(L, -2, "StringReader");
-
-			lua_pushcfunction(L, &lua_ZipReader);
-			lua_setfield(L, -2, "ZipReader");
+			const auto nargs = lua_gettop(L);
+			lua_pushinteger(L, (lua_Integer)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+			lua_pushvalue(L, lua_upvalueindex(2));
+			lua_rotate(L, 1, 2); // start time and binding go below the arguments
+			binding_raised_exception = false;
+			return lua_statsFinish(L, lua_pcallk(L, nargs, LUA_MULTRET, 0, 0, &lua_statsFinish), 0);
 		}
 
-		static int lua_FileReader(lua_State* L)
+		static int lua_statsFinish(lua_State* L, int status, lua_KContext)
 		{
-			pushNewAndBeginMt(FileReader, luaL_checkstring(L, 1));
-			lua_setmetatable(L, -2);
-			return 1;
-		}
+			auto& stats = *reinterpret_cast<BindingStats*>(lua_touserdata(L, lua_upvalueindex(1)));
+			const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			const auto ns = (uint64_t)(now - lua_tointeger(L, 1));
+			if (status != LUA_OK && status != LUA_YIELD)
+			{
+				if (std::exchange(binding_raised_exception, false))
+				{
+					stats.exceptions.fetch_add(1, std::memory_order_relaxed);
+				}
+				stats.record(ns, 0);
+				return lua_error(L);
+			}
 
-		static int lua_StringReader(lua_State* L)
-		{
-			pushNewAndBeginMt(StringReader, checkString(L, 1));
-			lua_setmetatable(L, -2);
-			return 1;
+			uint64_t bytes = 0;
+			for (int i = 2; i <= lua_gettop(L); ++i)
+			{
+				if (lua_type(L, i) == LUA_TSTRING)
+				{
+					bytes += lua_rawlen(L, i);
+				}
+			}
+			stats.record(ns, bytes);
+			return lua_gettop(L) - 1;
 		}
+#endif
 
-		static int lua_ZipReader(lua_State* L)
+		static void open_setStatsField(lua_State* L)
 		{
-			checkTypeExtendsReader(L, 1);
-			pushNewAndBeginMt(ZipReader, *reinterpret_cast<soup::Reader*>(lua_touserdata(L, 1)));
+			lua_newtable(L);
+			lua_pushboolean(L, SOUP_LUA_BINDINGS_STATS);
+			lua_setfield(L, -2, "enabled");
+			lua_pushcfunction(L, [](lua_State*) -> int
 			{
-				lua_pushstring(L, "__index");
-				lua_pushcfunction(L, [](lua_State* L) -> int
+				auto& registry = getBindingStatsRegistry();
+				std::lock_guard lock(registry.mtx);
+				for (auto& e : registry.stats)
 				{
-					switch (joaat::hash(luaL_checkstring(L, 2)))
-					{
-					case joaat::hash("getFileList"):
-						lua_pushcfunction(L, &lua_ZipReader_getFileList);
-						return 1;
-
-					case joaat::hash("getFileContents"):
-						lua_pushcfunction(L, &lua_ZipReader_getFileContents);
-						return 1;
-					}
-					return 0;
-				});
-				lua_settable(L, -3);
-			}
+					e.second.reset();
+				}
+				return 0;
+			});
+			lua_setfield(L, -2, "reset");
+			lua_pushcfunction(L, &lua_stats_pool);
+			lua_setfield(L, -2, "pool");
+			lua_newtable(L);
+			lua_pushcfunction(L, &lua_stats);
+			lua_setfield(L, -2, "__call");
 			lua_setmetatable(L, -2);
-			return 1;
+			lua_setfield(L, -2, "stats");
 		}
 
-		static int lua_ZipReader_getFileList(lua_State* L)
+		static int lua_stats(lua_State* L)
 		{
+			auto& registry = getBindingStatsRegistry();
+			std::lock_guard lock(registry.mtx);
 			lua_newtable(L);
-			size_t i = 1;
-			for (const auto& f : reinterpret_cast<soup::ZipReader*>(lua_touserdata(L, 1))->getFileList())
+			for (const auto& [name, stats] : registry.stats)
 			{
-				lua_pushinteger(L, i++);
-				lua_newtable(L);
+				if (stats.calls == 0 && stats.exceptions == 0)
 				{
-					pushString(L, "name");
-					pushString(L, f.name);
-					lua_settable(L, -3);
+					continue;
 				}
+				lua_createtable(L, 0, 5);
+				lua_pushinteger(L, (lua_Integer)stats.calls.load());
+				lua_setfield(L, -2, "calls");
+				lua_pushinteger(L, (lua_Integer)stats.total_ns.load());
+				lua_setfield(L, -2, "total_ns");
+				lua_pushinteger(L, (lua_Integer)stats.bytes_returned.load());
+				lua_setfield(L, -2, "bytes_returned");
+				lua_pushinteger(L, (lua_Integer)stats.exceptions.load());
+				lua_setfield(L, -2, "exceptions");
+				lua_createtable(L, (int)BindingStats::NUM_BUCKETS, 0);
+				for (size_t i = 0; i != BindingStats::NUM_BUCKETS; ++i)
 				{
-					pushString(L, "offset");
-					lua_pushinteger(L, f.offset);
-					lua_settable(L, -3);
+					lua_pushinteger(L, (lua_Integer)stats.histogram[i].load());
+					lua_rawseti(L, -2, (lua_Integer)i + 1);
 				}
-				lua_settable(L, -3);
+				lua_setfield(L, -2, "histogram");
+				lua_setfield(L, -2, name.c_str());
 			}
 			return 1;
 		}
 
-		static int lua_ZipReader_getFileContents(lua_State* L)
+		static int lua_stats_pool(lua_State* L)
 		{
-			return tryCatch(L, [](lua_State* L)
+			void* ud;
+			if (lua_getallocf(L, &ud) != &PoolAllocator::alloc)
 			{
-				uint32_t offset;
-				if (lua_type(L, 2) == LUA_TTABLE)
-				{
-					if (lua_getfield(L, 2, "offset"))
-					{
-						offset = (uint32_t)luaL_checkinteger(L, -1);
-						lua_pop(L, 1);
-					}
-					else
-					{
-						offset = (uint32_t)luaL_checkinteger(L, 2);
-					}
-				}
-				else
-				{
-					offset = (uint32_t)luaL_checkinteger(L, 2);
-				}
-
-				pushString(L, reinterpret_cast<soup::ZipReader*>(lua_touserdata(L, 1))->getFileContents(offset));
-				return 1;
-			});
+				return 0;
+			}
+			const auto stats = reinterpret_cast<const PoolAllocator*>(ud)->getStats();
+			lua_createtable(L, 0, 8);
+			lua_pushinteger(L, (lua_Integer)stats.slabs);
+			lua_setfield(L, -2, "slabs");
+			lua_pushinteger(L, (lua_Integer)stats.blocks_in_use);
+			lua_setfield(L, -2, "blocks_in_use");
+			lua_pushinteger(L, (lua_Integer)stats.bytes_in_use);
+			lua_setfield(L, -2, "bytes_in_use");
+			lua_pushinteger(L, (lua_Integer)stats.bytes_requested);
+			lua_setfield(L, -2, "bytes_requested");
+			lua_pushinteger(L, (lua_Integer)stats.bytes_free);
+			lua_setfield(L, -2, "bytes_free");
+			lua_pushinteger(L, (lua_Integer)stats.pooled_allocs);
+			lua_setfield(L, -2, "pooled_allocs");
+			lua_pushinteger(L, (lua_Integer)stats.fallback_allocs);
+			lua_setfield(L, -2, "fallback_allocs");
+			lua_pushnumber(L, stats.getFragmentation());
+			lua_setfield(L, -2, "fragmentation");
+			return 1;
 		}
-#pragma endregion Lua API - I/O
+#pragma endregion Stats
 
 #pragma region Lua Helpers
 		[[nodiscard]] static IpAddr checkIpAddr(lua_State* L, int i)
@@ -560,7 +5575,8 @@ namespace soup
 			}
 			else if (lua_type(L, i) == LUA_TUSERDATA)
 			{
-				return *(IpAddr*)lua_touserdata(L, 1);
+				checkType(L, i, desc_IpAddr());
+				return *(IpAddr*)lua_touserdata(L, i);
 			}
 			return IpAddr(native_u32_t((uint32_t)luaL_checkinteger(L, i)));
 		}
@@ -607,19 +5623,153 @@ namespace soup
 		}
 
 		template <typename T, typename...Args>
-		static T* pushNewAndBeginMtImpl(lua_State* L, const char* tn, Args&&...args)
+		static T* pushNewWithMt(lua_State* L, const TypeDesc& desc, Args&&...args)
 		{
 			auto inst = pushNew<T>(L, std::forward<Args>(args)...);
-			lua_newtable(L);
-			addDtorToMt<T>(L);
+			if (luaL_newmetatable(L, desc.name)) // also sets __name
 			{
-				lua_pushstring(L, "__name");
-				lua_pushstring(L, tn);
-				lua_settable(L, -3);
+				if constexpr (!std::is_trivially_destructible_v<T>)
+				{
+					addDtorToMt<T>(L); // finalizers make the GC keep track of the object and delay its collection by a cycle
+				}
+				lua_pushlightuserdata(L, const_cast<TypeDesc*>(&desc));
+				lua_rawsetp(L, -2, &type_tag_key);
+				initMt(L, desc);
 			}
+			lua_setmetatable(L, -2);
 			return inst;
 		}
 
+		static void initMt(lua_State* L, const TypeDesc& desc)
+		{
+			if (desc.metamethods)
+			{
+				setFuncs(L, desc.metamethods, desc.name);
+			}
+			// Methods, getters and setters reinterpret argument 1 as the type, but scripts can reach them without an instance,
+			// e.g. via getmetatable(obj).__index, so they check it first.
+			if (desc.getters)
+			{
+				pushMethodTable(L, desc);
+				pushFuncTable(L, desc.getters, desc.name);
+				lua_pushlightuserdata(L, const_cast<TypeDesc*>(&desc));
+				lua_pushcclosure(L, &lua_mm_index, 3);
+				lua_setfield(L, -2, "__index");
+			}
+			else if (desc.methods)
+			{
+				pushMethodTable(L, desc);
+				lua_setfield(L, -2, "__index");
+			}
+			if (desc.setters)
+			{
+				pushFuncTable(L, desc.setters, desc.name, "=");
+				lua_pushlightuserdata(L, const_cast<TypeDesc*>(&desc));
+				lua_pushcclosure(L, &lua_mm_newindex, 2);
+				lua_setfield(L, -2, "__newindex");
+			}
+		}
+
+		static void pushFuncTable(lua_State* L, const luaL_Reg* functions, const char* type_name, const char* suffix = "")
+		{
+			lua_newtable(L);
+			if (functions)
+			{
+				setFuncs(L, functions, type_name, suffix);
+			}
+		}
+
+		// Like pushFuncTable, but each method is wrapped in lua_checkSelf.
+		static void pushMethodTable(lua_State* L, const TypeDesc& desc)
+		{
+			lua_newtable(L);
+			if (!desc.methods)
+			{
+				return;
+			}
+			for (auto f = desc.methods; f->name; ++f)
+			{
+				lua_pushlightuserdata(L, const_cast<TypeDesc*>(&desc));
+				lua_pushcfunction(L, f->func);
+				lua_pushcclosure(L, &lua_checkSelf, 2);
+#if SOUP_LUA_BINDINGS_STATS
+				instrumentFunction(L, std::string(desc.name).append(1, '.').append(f->name));
+#endif
+				lua_setfield(L, -2, f->name);
+			}
+		}
+
+		// upvalue 1 = TypeDesc, upvalue 2 = method
+		static int lua_checkSelf(lua_State* L)
+		{
+			checkType(L, 1, *reinterpret_cast<const TypeDesc*>(lua_touserdata(L, lua_upvalueindex(1))));
+			return lua_tocfunction(L, lua_upvalueindex(2))(L);
+		}
+
+		// Like luaL_setfuncs, but with instrumentation if enabled. The binding's stats are recorded as `type_name.name` + suffix.
+		static void setFuncs(lua_State* L, const luaL_Reg* functions, [[maybe_unused]] const char* type_name, [[maybe_unused]] const char* suffix = "")
+		{
+#if SOUP_LUA_BINDINGS_STATS
+			for (; functions->name; ++functions)
+			{
+				lua_pushcfunction(L, functions->func);
+				instrumentFunction(L, std::string(type_name).append(1, '.').append(functions->name).append(suffix));
+				lua_setfield(L, -2, functions->name);
+			}
+#else
+			luaL_setfuncs(L, functions, 0);
+#endif
+		}
+
+		// upvalue 1 = methods, upvalue 2 = getters, upvalue 3 = TypeDesc
+		static int lua_mm_index(lua_State* L)
+		{
+			lua_settop(L, 2);
+			lua_pushvalue(L, 2);
+			if (lua_rawget(L, lua_upvalueindex(1)) != LUA_TNIL)
+			{
+				return 1;
+			}
+			lua_pushvalue(L, 2);
+			if (lua_rawget(L, lua_upvalueindex(2)) == LUA_TFUNCTION)
+			{
+				checkType(L, 1, *reinterpret_cast<const TypeDesc*>(lua_touserdata(L, lua_upvalueindex(3))));
+#if SOUP_LUA_BINDINGS_STATS
+				// The getter is wrapped in a trampoline closure, so it has to be called as such.
+				lua_insert(L, 1);
+				lua_settop(L, 3);
+				lua_call(L, 2, 1);
+				return 1;
+#else
+				const auto getter = lua_tocfunction(L, -1);
+				lua_settop(L, 2);
+				return getter(L);
+#endif
+			}
+			return 0;
+		}
+
+		// upvalue 1 = setters, upvalue 2 = TypeDesc
+		static int lua_mm_newindex(lua_State* L)
+		{
+			lua_settop(L, 3);
+			lua_pushvalue(L, 2);
+			if (lua_rawget(L, lua_upvalueindex(1)) == LUA_TFUNCTION)
+			{
+				checkType(L, 1, *reinterpret_cast<const TypeDesc*>(lua_touserdata(L, lua_upvalueindex(2))));
+#if SOUP_LUA_BINDINGS_STATS
+				lua_insert(L, 1);
+				lua_call(L, 3, 0);
+				return 0;
+#else
+				const auto setter = lua_tocfunction(L, -1);
+				lua_settop(L, 3);
+				return setter(L);
+#endif
+			}
+			return 0;
+		}
+
 		template <typename T>
 		static void addDtorToMt(lua_State* L)
 		{
@@ -649,53 +5799,50 @@ namespace soup
 
 		static Vector3* pushNewVector3(lua_State* L)
 		{
-			auto v = pushNewAndBeginMt(Vector3);
-			{
-				lua_pushstring(L, "__index");
-				lua_pushcfunction(L, [](lua_State* L) -> int
-				{
-					switch (joaat::hash(luaL_checkstring(L, 2)))
-					{
-					case joaat::hash("x"):
-						lua_pushnumber(L, reinterpret_cast<Vector3*>(lua_touserdata(L, 1))->x);
-						return 1;
+			return pushNewWithMt<Vector3>(L, desc_Vector3());
+		}
 
-					case joaat::hash("y"):
-						lua_pushnumber(L, reinterpret_cast<Vector3*>(lua_touserdata(L, 1))->y);
-						return 1;
+		[[nodiscard]] static Vector3& checkVector3(lua_State* L, int i)
+		{
+			checkType(L, i, desc_Vector3());
+			return *reinterpret_cast<Vector3*>(lua_touserdata(L, i));
+		}
 
-					case joaat::hash("z"):
-						lua_pushnumber(L, reinterpret_cast<Vector3*>(lua_touserdata(L, 1))->z);
-						return 1;
-					}
-					return 0;
-				});
-				lua_settable(L, -3);
-			}
+		static inline const char type_tag_key{};
+
+		[[nodiscard]] static const TypeDesc* getTypeDesc(lua_State* L, int i)
+		{
+			const TypeDesc* ret = nullptr;
+			if (lua_getmetatable(L, i))
 			{
-				lua_pushstring(L, "__newindex");
-				lua_pushcfunction(L, [](lua_State* L) -> int
+				if (lua_rawgetp(L, -1, &type_tag_key) == LUA_TLIGHTUSERDATA)
 				{
-					switch (joaat::hash(luaL_checkstring(L, 2)))
-					{
-					case joaat::hash("x"):
-						reinterpret_cast<Vector3*>(lua_touserdata(L, 1))->x = (float)luaL_checknumber(L, 3);
-						return 1;
+					ret = reinterpret_cast<const TypeDesc*>(lua_touserdata(L, -1));
+				}
+				lua_pop(L, 2);
+			}
+			return ret;
+		}
 
-					case joaat::hash("y"):
-						reinterpret_cast<Vector3*>(lua_touserdata(L, 1))->y = (float)luaL_checknumber(L, 3);
-						return 1;
+		// True if the value at i is an instance of the given type or of a type deriving from it.
+		[[nodiscard]] static bool isType(lua_State* L, int i, const TypeDesc& desc)
+		{
+			for (auto val_desc = getTypeDesc(L, i); val_desc != nullptr; val_desc = (val_desc->base ? &val_desc->base() : nullptr))
+			{
+				if (val_desc == &desc)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
 
-					case joaat::hash("z"):
-						reinterpret_cast<Vector3*>(lua_touserdata(L, 1))->z = (float)luaL_checknumber(L, 3);
-						return 1;
-					}
-					return 0;
-				});
-				lua_settable(L, -3);
+		static void checkType(lua_State* L, int i, const TypeDesc& desc)
+		{
+			if (!isType(L, i, desc))
+			{
+				luaL_typeerror(L, i, desc.name);
 			}
-			lua_setmetatable(L, -2);
-			return v;
 		}
 
 		[[nodiscard]] static bool isTypename(lua_State* L, int i, const char* tn)
@@ -768,54 +5915,44 @@ namespace soup
 			}
 			catch(std::exception& e)
 			{
-				luaL_error(L, e.what());
+#if SOUP_LUA_BINDINGS_STATS
+				binding_raised_exception = true;
+#endif
+				luaL_error(L, "%s", e.what()); // the message may contain user input, e.g. paths or entry names
 			}
 		}
 
 		static void checkTypeExtendsReader(lua_State* L, int i)
 		{
-			if (!isTypename(L, i, "soup::FileReader")
-				&& !isTypename(L, i, "soup::StringReader")
-				)
-			{
-				luaL_typeerror(L, 1, "soup::Reader");
-			}
+			checkType(L, i, desc_Reader());
 		}
 
 		static void checkTypeExtendsAudSound(lua_State* L, int i)
 		{
-			if (!isTypename(L, i, "soup::SharedPtr<soup::audWav>"))
-			{
-				luaL_typeerror(L, 1, "soup::SharedPtr<soup::audSound>");
-			}
+			checkType(L, i, desc_audSound());
 		}
 
-		static audPlayback* pushNewAudPlayback(lua_State* L)
+		static const TypeDesc& desc_audPlayback()
 		{
-			auto v = pushNewAndBeginMt(audPlayback);
-			{
-				lua_pushstring(L, "__index");
-				lua_pushcfunction(L, [](lua_State* L) -> int
+			static constexpr luaL_Reg methods[] = {
+				{"isPlaying", [](lua_State* L) -> int
 				{
-					switch (joaat::hash(luaL_checkstring(L, 2)))
-					{
-					case joaat::hash("isPlaying"):
-						lua_pushcfunction(L, [](lua_State* L)
-						{
-							lua_pushboolean(L, reinterpret_cast<audPlayback*>(lua_touserdata(L, 1))->isPlaying());
-							return 1;
-						});
-						return 1;
-					}
-					return 0;
-				});
-				lua_settable(L, -3);
-			}
-			lua_setmetatable(L, -2);
-			return v;
+					lua_pushboolean(L, reinterpret_cast<audPlayback*>(lua_touserdata(L, 1))->isPlaying());
+					return 1;
+				}},
+				{nullptr, nullptr}
+			};
+			static constexpr TypeDesc desc{
+				.name = "soup::audPlayback",
+				.methods = methods,
+			};
+			return desc;
 		}
-#pragma endregion Lua Helpers
 
-#undef pushNewAndBeginMt
+		static audPlayback* pushNewAudPlayback(lua_State* L)
+		{
+			return pushNewWithMt<audPlayback>(L, desc_audPlayback());
+		}
+#pragma endregion Lua Helpers
 	};
 }
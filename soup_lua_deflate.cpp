@@ -0,0 +1,465 @@
+#include "soup_lua_deflate.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace soup
+{
+	namespace
+	{
+		// Matches are found with hash chains over the window, the level deciding how far down a chain to look, and every block
+		// gets its own Huffman codes.
+		struct DeflateEncoder
+		{
+			static constexpr size_t WINDOW_SIZE = 0x8000;
+			static constexpr int MAX_BITS = 15;
+			static constexpr size_t MIN_MATCH = 3;
+			static constexpr size_t MAX_MATCH = 258;
+			static constexpr int HASH_BITS = 15;
+			static constexpr size_t BLOCK_SYMBOLS = 0x8000;
+
+			static constexpr uint16_t LEN_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+			static constexpr uint8_t LEN_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+			static constexpr uint16_t DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+			static constexpr uint8_t DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+			static constexpr uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+			// A literal if dist is 0, a match of length len otherwise.
+			struct Symbol
+			{
+				uint16_t len;
+				uint16_t dist;
+			};
+
+			std::string out{};
+			uint64_t bit_buf = 0;
+			int bit_count = 0;
+
+			[[nodiscard]] static std::string compress(const uint8_t* data, size_t size, int level)
+			{
+				static constexpr uint16_t max_chain[10] = { 0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096 };
+				static constexpr uint16_t nice_len[10] = { 0, 8, 16, 32, 16, 32, 128, 128, 258, 258 };
+				level = std::clamp(level, 1, 9);
+
+				DeflateEncoder c;
+				c.out.reserve(size / 2 + 64);
+
+				// Positions are stored plus one, so 0 ends a chain.
+				std::vector<uint32_t> head(size_t(1) << HASH_BITS, 0);
+				std::vector<uint32_t> prev(WINDOW_SIZE, 0);
+				const auto hash = [data](size_t pos) -> uint32_t
+				{
+					const uint32_t v = data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16);
+					return (v * 2654435761u) >> (32 - HASH_BITS);
+				};
+				const auto insert = [&](size_t pos)
+				{
+					auto& h = head[hash(pos)];
+					prev[pos & (WINDOW_SIZE - 1)] = h;
+					h = (uint32_t)(pos + 1);
+				};
+
+				std::vector<Symbol> symbols;
+				symbols.reserve(BLOCK_SYMBOLS);
+				for (size_t pos = 0; pos != size; )
+				{
+					size_t best_len = 0;
+					size_t best_dist = 0;
+					if (size - pos >= MIN_MATCH)
+					{
+						const size_t max_len = std::min(MAX_MATCH, size - pos);
+						uint32_t candidate = head[hash(pos)];
+						for (int chain = max_chain[level]; candidate != 0 && chain != 0; --chain)
+						{
+							const size_t cpos = candidate - 1;
+							if (pos - cpos > WINDOW_SIZE)
+							{
+								break;
+							}
+							if (data[cpos + best_len] == data[pos + best_len])
+							{
+								size_t len = 0;
+								while (len != max_len && data[cpos + len] == data[pos + len])
+								{
+									++len;
+								}
+								if (len > best_len)
+								{
+									best_len = len;
+									best_dist = pos - cpos;
+									if (len >= nice_len[level] || len == max_len)
+									{
+										break;
+									}
+								}
+							}
+							candidate = prev[cpos & (WINDOW_SIZE - 1)];
+						}
+						// A 3-byte match far back costs about as many bits as the literals would.
+						if (best_len < MIN_MATCH || (best_len == MIN_MATCH && best_dist > 4096))
+						{
+							best_len = 0;
+						}
+					}
+
+					if (best_len != 0)
+					{
+						symbols.emplace_back(Symbol{ (uint16_t)best_len, (uint16_t)best_dist });
+						// The lower levels skip hashing the rest of the match, trading some ratio for speed.
+						const size_t end = pos + best_len;
+						const size_t hash_end = std::min(level >= 4 ? end : pos + 1, size - MIN_MATCH + 1);
+						for (; pos < hash_end; ++pos)
+						{
+							insert(pos);
+						}
+						pos = end;
+					}
+					else
+					{
+						symbols.emplace_back(Symbol{ data[pos], 0 });
+						if (size - pos >= MIN_MATCH)
+						{
+							insert(pos);
+						}
+						++pos;
+					}
+
+					if (symbols.size() == BLOCK_SYMBOLS)
+					{
+						c.writeBlock(symbols, false);
+						symbols.clear();
+					}
+				}
+				c.writeBlock(symbols, true);
+				if (c.bit_count != 0)
+				{
+					c.out.push_back((char)c.bit_buf);
+				}
+				return std::move(c.out);
+			}
+
+		private:
+			void putBits(uint32_t value, int count)
+			{
+				bit_buf |= (uint64_t)value << bit_count;
+				bit_count += count;
+				while (bit_count >= 8)
+				{
+					out.push_back((char)bit_buf);
+					bit_buf >>= 8;
+					bit_count -= 8;
+				}
+			}
+
+			[[nodiscard]] static unsigned lenCode(size_t len) noexcept
+			{
+				return (unsigned)(std::upper_bound(std::begin(LEN_BASE), std::end(LEN_BASE), len) - std::begin(LEN_BASE) - 1);
+			}
+
+			[[nodiscard]] static unsigned distCode(size_t dist) noexcept
+			{
+				return (unsigned)(std::upper_bound(std::begin(DIST_BASE), std::end(DIST_BASE), dist) - std::begin(DIST_BASE) - 1);
+			}
+
+			// Huffman code lengths of at most max_bits for the given frequencies. The code is always complete, as zlib rejects
+			// incomplete ones, so a lone symbol gets a partner.
+			static void buildLengths(const uint32_t* freq, size_t n, uint8_t* lens, int max_bits)
+			{
+				std::fill_n(lens, n, 0);
+				std::vector<std::pair<uint32_t, uint16_t>> leaves;
+				for (size_t i = 0; i != n; ++i)
+				{
+					if (freq[i] != 0)
+					{
+						leaves.emplace_back(freq[i], (uint16_t)i);
+					}
+				}
+				if (leaves.empty())
+				{
+					return;
+				}
+				if (leaves.size() == 1)
+				{
+					lens[leaves[0].second] = 1;
+					lens[leaves[0].second == 0 ? 1 : 0] = 1;
+					return;
+				}
+				std::sort(leaves.begin(), leaves.end());
+
+				// With the leaves sorted, the internal nodes are created in order of weight, so two queues replace a heap.
+				// Parents always come after their children.
+				const size_t num_leaves = leaves.size();
+				const size_t num_nodes = num_leaves * 2 - 1;
+				std::vector<uint32_t> weight(num_nodes);
+				std::vector<uint32_t> parent(num_nodes);
+				for (size_t i = 0; i != num_leaves; ++i)
+				{
+					weight[i] = leaves[i].first;
+				}
+				size_t next_leaf = 0;
+				size_t next_internal = num_leaves;
+				const auto pick = [&](size_t end_internal)
+				{
+					if (next_leaf != num_leaves && (next_internal == end_internal || weight[next_leaf] <= weight[next_internal]))
+					{
+						return next_leaf++;
+					}
+					return next_internal++;
+				};
+				for (size_t node = num_leaves; node != num_nodes; ++node)
+				{
+					const auto a = pick(node);
+					const auto b = pick(node);
+					weight[node] = weight[a] + weight[b];
+					parent[a] = parent[b] = (uint32_t)node;
+				}
+				std::vector<uint32_t> depth(num_nodes);
+				depth[num_nodes - 1] = 0;
+				for (size_t i = num_nodes - 1; i-- != 0; )
+				{
+					depth[i] = depth[parent[i]] + 1;
+				}
+
+				// Clamp to max_bits, then move leaves between lengths until the Kraft sum is exactly 1 again.
+				uint32_t count[MAX_BITS + 1]{};
+				for (size_t i = 0; i != num_leaves; ++i)
+				{
+					++count[std::min<uint32_t>(depth[i], max_bits)];
+				}
+				const uint32_t one = (uint32_t)1 << max_bits;
+				uint32_t kraft = 0;
+				for (int l = 1; l <= max_bits; ++l)
+				{
+					kraft += count[l] << (max_bits - l);
+				}
+				while (kraft > one)
+				{
+					int l = max_bits - 1;
+					while (count[l] == 0)
+					{
+						--l;
+					}
+					--count[l];
+					++count[l + 1];
+					kraft -= (uint32_t)1 << (max_bits - l - 1);
+				}
+				while (kraft < one)
+				{
+					int l = max_bits;
+					while (count[l] == 0 || ((uint32_t)1 << (max_bits - l)) > one - kraft)
+					{
+						--l;
+					}
+					--count[l];
+					++count[l - 1];
+					kraft += (uint32_t)1 << (max_bits - l);
+				}
+
+				// The least frequent symbols get the longest codes.
+				size_t k = 0;
+				for (int l = max_bits; l != 0; --l)
+				{
+					for (uint32_t i = 0; i != count[l]; ++i)
+					{
+						lens[leaves[k++].second] = (uint8_t)l;
+					}
+				}
+			}
+
+			// Canonical codes, bit-reversed since deflate streams are written starting at the least significant bit.
+			static void buildCodes(const uint8_t* lens, size_t n, uint16_t* codes)
+			{
+				uint16_t count[MAX_BITS + 1]{};
+				for (size_t i = 0; i != n; ++i)
+				{
+					++count[lens[i]];
+				}
+				count[0] = 0;
+				uint16_t next[MAX_BITS + 1]{};
+				uint16_t code = 0;
+				for (int bits = 1; bits <= MAX_BITS; ++bits)
+				{
+					code = (uint16_t)((code + count[bits - 1]) << 1);
+					next[bits] = code;
+				}
+				for (size_t i = 0; i != n; ++i)
+				{
+					if (lens[i] != 0)
+					{
+						uint16_t c = next[lens[i]]++;
+						uint16_t reversed = 0;
+						for (int b = 0; b != lens[i]; ++b)
+						{
+							reversed = (uint16_t)((reversed << 1) | (c & 1));
+							c >>= 1;
+						}
+						codes[i] = reversed;
+					}
+				}
+			}
+
+			void writeBlock(const std::vector<Symbol>& symbols, bool last)
+			{
+				uint32_t litlen_freq[286]{};
+				uint32_t dist_freq[30]{};
+				for (const auto& s : symbols)
+				{
+					if (s.dist == 0)
+					{
+						++litlen_freq[s.len];
+					}
+					else
+					{
+						++litlen_freq[257 + lenCode(s.len)];
+						++dist_freq[distCode(s.dist)];
+					}
+				}
+				litlen_freq[256] = 1;
+
+				uint8_t litlen_lens[286];
+				uint8_t dist_lens[30];
+				buildLengths(litlen_freq, 286, litlen_lens, MAX_BITS);
+				buildLengths(dist_freq, 30, dist_lens, MAX_BITS);
+				if (std::all_of(std::begin(dist_lens), std::end(dist_lens), [](uint8_t l) { return l == 0; }))
+				{
+					dist_lens[0] = 1;
+					dist_lens[1] = 1;
+				}
+				size_t hlit = 286;
+				while (litlen_lens[hlit - 1] == 0)
+				{
+					--hlit;
+				}
+				size_t hdist = 30;
+				while (dist_lens[hdist - 1] == 0)
+				{
+					--hdist;
+				}
+
+				// The litlen and distance code lengths are sent as one sequence.
+				uint8_t lens[286 + 30];
+				std::copy_n(litlen_lens, hlit, lens);
+				std::copy_n(dist_lens, hdist, lens + hlit);
+				const size_t num_lens = hlit + hdist;
+
+				// Run-length encode them with symbols 16 (repeat previous), 17 and 18 (repeat zero).
+				struct CodeLengthSymbol
+				{
+					uint8_t symbol;
+					uint8_t extra;
+				};
+				std::vector<CodeLengthSymbol> cl_symbols;
+				uint32_t cl_freq[19]{};
+				const auto emit = [&](uint8_t symbol, uint8_t extra)
+				{
+					cl_symbols.emplace_back(CodeLengthSymbol{ symbol, extra });
+					++cl_freq[symbol];
+				};
+				for (size_t i = 0; i != num_lens; )
+				{
+					const uint8_t l = lens[i];
+					size_t run = 1;
+					while (i + run != num_lens && lens[i + run] == l)
+					{
+						++run;
+					}
+					i += run;
+					if (l == 0)
+					{
+						for (; run >= 11; )
+						{
+							const auto n = std::min<size_t>(run, 138);
+							emit(18, (uint8_t)(n - 11));
+							run -= n;
+						}
+						if (run >= 3)
+						{
+							emit(17, (uint8_t)(run - 3));
+							run = 0;
+						}
+					}
+					else
+					{
+						emit(l, 0);
+						--run;
+						for (; run >= 3; )
+						{
+							const auto n = std::min<size_t>(run, 6);
+							emit(16, (uint8_t)(n - 3));
+							run -= n;
+						}
+					}
+					for (; run != 0; --run)
+					{
+						emit(l, 0);
+					}
+				}
+				uint8_t cl_lens[19];
+				uint16_t cl_codes[19]{};
+				buildLengths(cl_freq, 19, cl_lens, 7);
+				buildCodes(cl_lens, 19, cl_codes);
+				size_t hclen = 19;
+				while (hclen > 4 && cl_lens[CODE_LENGTH_ORDER[hclen - 1]] == 0)
+				{
+					--hclen;
+				}
+
+				uint16_t litlen_codes[286]{};
+				uint16_t dist_codes[30]{};
+				buildCodes(litlen_lens, 286, litlen_codes);
+				buildCodes(dist_lens, 30, dist_codes);
+
+				putBits(last, 1);
+				putBits(2, 2);
+				putBits((uint32_t)(hlit - 257), 5);
+				putBits((uint32_t)(hdist - 1), 5);
+				putBits((uint32_t)(hclen - 4), 4);
+				for (size_t i = 0; i != hclen; ++i)
+				{
+					putBits(cl_lens[CODE_LENGTH_ORDER[i]], 3);
+				}
+				for (const auto& s : cl_symbols)
+				{
+					putBits(cl_codes[s.symbol], cl_lens[s.symbol]);
+					if (s.symbol == 16)
+					{
+						putBits(s.extra, 2);
+					}
+					else if (s.symbol == 17)
+					{
+						putBits(s.extra, 3);
+					}
+					else if (s.symbol == 18)
+					{
+						putBits(s.extra, 7);
+					}
+				}
+
+				for (const auto& s : symbols)
+				{
+					if (s.dist == 0)
+					{
+						putBits(litlen_codes[s.len], litlen_lens[s.len]);
+					}
+					else
+					{
+						const auto lc = lenCode(s.len);
+						putBits(litlen_codes[257 + lc], litlen_lens[257 + lc]);
+						putBits((uint32_t)(s.len - LEN_BASE[lc]), LEN_EXTRA[lc]);
+						const auto dc = distCode(s.dist);
+						putBits(dist_codes[dc], dist_lens[dc]);
+						putBits((uint32_t)(s.dist - DIST_BASE[dc]), DIST_EXTRA[dc]);
+					}
+				}
+				putBits(litlen_codes[256], litlen_lens[256]);
+			}
+		};
+	}
+
+	std::string LuaDeflateCompressor::compress(const uint8_t* data, size_t size, int level)
+	{
+		return DeflateEncoder::compress(data, size, level);
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace soup
+{
+	// Produces a raw deflate stream (RFC 1951), as used by ZipWriter. Unlike the bindings themselves, it lives in a translation
+	// unit of its own, soup_lua_deflate.cpp, so it can be tested on its own; see tests/deflate_roundtrip.cpp.
+	struct LuaDeflateCompressor
+	{
+		// Levels 1 to 9 trade speed for size; anything outside of that is clamped.
+		[[nodiscard]] static std::string compress(const uint8_t* data, size_t size, int level);
+	};
+}
@@ -0,0 +1,83 @@
+// Round-trips data through the deflate encoder at every level, using Soup's decoder to check the result. Build and run it, e.g.:
+// clang++ -std=c++20 -O2 tests/deflate_roundtrip.cpp soup_lua_deflate.cpp -I. -I<path to Soup> <Soup library> -o deflate_roundtrip
+// Exits with 0 if all cases pass.
+
+#include "soup_lua_deflate.hpp"
+
+#include <cstdio>
+#include <iterator>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <soup/deflate.hpp>
+
+static std::vector<std::pair<const char*, std::string>> makeCases()
+{
+	std::vector<std::pair<const char*, std::string>> cases;
+	cases.emplace_back("empty", std::string{});
+	cases.emplace_back("one byte", std::string("x"));
+	cases.emplace_back("short text", std::string("The quick brown fox jumps over the lazy dog."));
+
+	std::string all_bytes;
+	for (int i = 0; i != 256; ++i)
+	{
+		all_bytes.push_back((char)i);
+	}
+	cases.emplace_back("all bytes", all_bytes);
+
+	// Runs longer than the longest match and matches at the distance of 1.
+	cases.emplace_back("one long run", std::string(100000, 'a'));
+
+	// Matches far back in the window, and more symbols than fit into one block.
+	std::mt19937 rng(1);
+	std::string words;
+	static constexpr const char* vocabulary[] = { "alpha ", "beta ", "gamma ", "delta ", "epsilon ", "zeta ", "eta ", "theta\n" };
+	while (words.size() < 300000)
+	{
+		words.append(vocabulary[rng() % std::size(vocabulary)]);
+	}
+	cases.emplace_back("words", words);
+
+	// Doesn't get smaller, so every block ends up close to its worst case.
+	std::string noise(200000, '\0');
+	for (auto& c : noise)
+	{
+		c = (char)rng();
+	}
+	cases.emplace_back("noise", noise);
+
+	// Repeats just outside of the window, which mustn't be matched.
+	std::string block(0x8000 + 7, '\0');
+	for (auto& c : block)
+	{
+		c = (char)rng();
+	}
+	cases.emplace_back("repeat beyond the window", block + block + block);
+
+	return cases;
+}
+
+int main()
+{
+	int failures = 0;
+	for (const auto& [name, data] : makeCases())
+	{
+		for (int level = 0; level <= 9; ++level)
+		{
+			const auto compressed = soup::LuaDeflateCompressor::compress(reinterpret_cast<const uint8_t*>(data.data()), data.size(), level);
+			const auto res = soup::deflate::decompress(compressed);
+			if (res.decompressed != data)
+			{
+				std::printf("FAIL %s at level %d: %zu bytes in, %zu bytes back\n", name, level, data.size(), res.decompressed.size());
+				++failures;
+			}
+			else if (level == 9)
+			{
+				std::printf("ok   %s: %zu -> %zu bytes\n", name, data.size(), compressed.size());
+			}
+		}
+	}
+	return failures != 0;
+}
@@ -0,0 +1,80 @@
+// Checks that a failed background load of the netIntel data can be retried with soup.netIntel.preload or wait. Build and run
+// it like bench.cpp, e.g.:
+// clang++ -std=c++20 -O2 tests/netintel_retry.cpp soup_lua_deflate.cpp -I. -I<path to Soup> -I<path to Lua or Pluto> <Soup library> <Lua or Pluto library> -o netintel_retry
+// Exits with 0 if it passes.
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+
+#include "soup_lua_bindings.hpp"
+
+#include <atomic>
+#include <cstdio>
+
+static std::atomic_bool load_fails{true};
+
+struct FlakyDataProvider : public soup::LuaBindings::DataProvider
+{
+	soup::netIntel intel{};
+
+	soup::netIntel& getNetIntel(lua_State*) override
+	{
+		return intel;
+	}
+
+	soup::netIntel& loadNetIntel() override
+	{
+		if (load_fails)
+		{
+			throw soup::Exception("flaky load failed");
+		}
+		return intel;
+	}
+};
+
+static const char* const script = R"(
+	soup.netIntel.preload()
+	local ok, err = pcall(soup.netIntel.wait)
+	assert(not ok and err:find("flaky load failed"), "wait didn't raise the load's error: " .. tostring(err))
+	ok, err = pcall(soup.netIntel.getAsByIp, "1.1.1.1")
+	assert(not ok and err:find("flaky load failed"), "lookup didn't raise the load's error: " .. tostring(err))
+	assert(not soup.netIntel.isReady())
+
+	-- wait retries, and the load fails again
+	ok, err = pcall(soup.netIntel.wait)
+	assert(not ok and err:find("flaky load failed"), "wait didn't retry: " .. tostring(err))
+
+	set_load_fails(false)
+	soup.netIntel.preload()
+	assert(soup.netIntel.wait(10000), "retry didn't finish")
+	assert(soup.netIntel.isReady(), "retry didn't publish the data")
+	soup.netIntel.getAsByIp("1.1.1.1")
+)";
+
+int main()
+{
+	soup::LuaBindings::data_provider = soup::make_unique<FlakyDataProvider>();
+
+	lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+	soup::LuaBindings::open(L);
+	lua_register(L, "set_load_fails", [](lua_State* L) -> int
+	{
+		load_fails = lua_toboolean(L, 1);
+		return 0;
+	});
+
+	int ret = 0;
+	if (luaL_dostring(L, script) != LUA_OK)
+	{
+		std::printf("FAIL %s\n", lua_tostring(L, -1));
+		ret = 1;
+	}
+	else
+	{
+		std::printf("ok\n");
+	}
+	lua_close(L);
+	return ret;
+}